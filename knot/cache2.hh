@@ -4,75 +4,245 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "refptr.hh"
 
 extern ssize_t g_cache_max;
+extern size_t g_cache_mmap_min;
 
 struct cache_entry {
 
-    cache_entry(const std::string &n, char *d, size_t len)
-	: _filename(n), _data(d), _len(len), _refcount(1), _next(0), _prev(0) {
+    // Heap entry: @a d holds the response header followed by the body.
+    cache_entry(const std::string &n, char *d, size_t hdrlen, size_t len)
+	: _filename(n), _data(d), _hdrlen(hdrlen), _body(d + hdrlen),
+	  _bodylen(len - hdrlen), _mapped(false), _charge(len), _refcount(1),
+	  _hash(0), _hnext(0), _next(0), _prev(0) {
+    }
+
+    // Mapped entry: @a hdr holds the header; the body is the file mapping.
+    cache_entry(const std::string &n, char *hdr, size_t hdrlen,
+		char *body, size_t bodylen, size_t charge)
+	: _filename(n), _data(hdr), _hdrlen(hdrlen), _body(body),
+	  _bodylen(bodylen), _mapped(true), _charge(charge), _refcount(1),
+	  _hash(0), _hnext(0), _next(0), _prev(0) {
     }
 
     ~cache_entry() {
 	assert(!_prev && !_next);
+	if (_mapped && _bodylen)
+	    munmap(_body, _bodylen);
 	delete[] _data;
     }
 
+    // entries may be shared by several loops' threads
     void use() {
-	_refcount++;
+	__sync_add_and_fetch(&_refcount, 1);
     }
 
     void unuse() {
-	if (!--_refcount)
+	if (__sync_sub_and_fetch(&_refcount, 1) == 0)
 	    delete this;
     }
 
+    // true iff header and body are contiguous, so data() holds the
+    // whole response
+    bool contiguous() const {
+	return !_mapped;
+    }
+
     char *data() const {
 	return _data;
     }
 
     size_t size() const {
-	return _len;
+	return _hdrlen + _bodylen;
+    }
+
+    const char *header() const {
+	return _data;
+    }
+
+    size_t header_size() const {
+	return _hdrlen;
+    }
+
+    const char *body() const {
+	return _body;
+    }
+
+    size_t body_size() const {
+	return _bodylen;
+    }
+
+    // bytes charged against the cache's capacity
+    size_t charge() const {
+	return _charge;
+    }
+
+    // identity of the file this entry was loaded from
+    void set_source(const struct stat &st) {
+	_dev = st.st_dev;
+	_ino = st.st_ino;
+	_mtime = st.st_mtime;
+	_fsize = st.st_size;
+	_checked = time(0);
+    }
+
+    // true at most once a second per entry
+    bool revalidate_due(time_t now) {
+	if (now == _checked)
+	    return false;
+	_checked = now;
+	return true;
+    }
+
+    bool same_source(const struct stat &st) const {
+	return _dev == st.st_dev && _ino == st.st_ino
+	    && _mtime == st.st_mtime && _fsize == st.st_size;
+    }
+
+    // validators for conditional and range requests
+    void set_validators(const char *etag, const char *last_modified) {
+	_etag = etag;
+	_last_modified = last_modified;
+    }
+
+    const char *etag() const {
+	return _etag.c_str();
+    }
+
+    const char *last_modified() const {
+	return _last_modified.c_str();
+    }
+
+    time_t mtime() const {
+	return _mtime;
+    }
+
+    // @a type and @a extra are static strings (see http_mime_type() and
+    // http_encoding_headers()); @a variants is the HTTP_ENCODING_* mask of
+    // precompressed siblings, known only for identity entries
+    void set_representation(const char *type, const char *extra,
+			    int variants) {
+	_type = type;
+	_extra = extra;
+	_variants = variants;
+    }
+
+    const char *content_type() const {
+	return _type;
+    }
+
+    const char *encoding_headers() const {
+	return _extra;
+    }
+
+    int variants() const {
+	return _variants;
     }
 
   private:
 
     std::string _filename;
     char *_data;
-    size_t _len;
+    size_t _hdrlen;
+    char *_body;
+    size_t _bodylen;
+    bool _mapped;
+    size_t _charge;
+    dev_t _dev;
+    ino_t _ino;
+    time_t _mtime;
+    off_t _fsize;
+    time_t _checked;		// last time the source was revalidated
+    std::string _etag;
+    std::string _last_modified;
+    const char *_type;
+    const char *_extra;
+    int _variants;
     unsigned _refcount;
-    cache_entry *_next;
+    unsigned _hash;
+    cache_entry *_hnext;	// hash chain
+    cache_entry *_next;		// LRU list, most recently used first
     cache_entry *_prev;
 
     friend class cache;
-    
+
 };
 
 
-class cache { public:
+struct cache_stats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long insertions;
+    unsigned long long evictions;
+    unsigned long long evicted_bytes;
+    size_t entries;
+    size_t load;
 
-    cache(size_t c)
-	: _load(0), _capacity(c), _head(0), _tail(0) {
+    cache_stats()
+	: hits(0), misses(0), insertions(0), evictions(0), evicted_bytes(0),
+	  entries(0), load(0) {
     }
+};
+
+
+// A byte-budgeted LRU cache keyed by filename. Entries are spread over
+// independently locked shards, each with its own hash index, LRU list and
+// share of the capacity, so loops on different threads rarely contend.
+
+class cache { public:
+
+    cache(size_t capacity, int nshards = 16);
+    ~cache();
 
     void insert(refptr<cache_entry> ce);
     refptr<cache_entry> get(const std::string &fn);
+    void erase(cache_entry *e);
 
     void empty();
-    void remove(cache_entry *);
-    void evict();
+    cache_stats stats();
 
   private:
 
-    size_t _load;
-    size_t _capacity;
-    cache_entry *_head;
-    cache_entry *_tail;
-    
+    struct shard {
+	pthread_mutex_t lock;
+	size_t load;
+	size_t capacity;
+	cache_entry **buckets;
+	unsigned bucket_mask;
+	size_t nentries;
+	cache_entry *head;
+	cache_entry *tail;
+	cache_stats stats;
+    };
+
+    shard *_shards;
+    unsigned _shard_mask;
+
+    static unsigned hash(const std::string &fn);
+    shard &shard_for(unsigned h) {
+	return _shards[(h >> 16) & _shard_mask];
+    }
+    cache_entry *&bucket(shard &s, unsigned h) {
+	return s.buckets[h & s.bucket_mask];
+    }
+
+    void link_front(shard &s, cache_entry *e);
+    void unlink(shard &s, cache_entry *e);
+    void remove(shard &s, cache_entry *e);
+    void grow(shard &s);
+
 };
 
-void cache_get(const char *filename, tamer::event<refptr<cache_entry> > done);
+// Look up @a filename's representation in @a encoding (an HTTP_ENCODING_*
+// value), loading it on a miss.
+void cache_get(const char *filename, int encoding,
+	       tamer::event<refptr<cache_entry> > done);
 void clear_cache();
+cache_stats cache_statistics();
 
 #endif
@@ -1,27 +1,96 @@
 #ifndef HTTP_H
 #define HTTP_H
 
-#include "input.hh"
 #include <tamer/tamer.hh>
+#include <tamer/fd.hh>
+#include <tamer/bufferedio.hh>
+#include <string>
+#include <time.h>
+#include <sys/stat.h>
 
+#define HTTP_MAX_HEADER 8192
+#define HTTP_ETAG_SIZE 64	// buffer size for http_etag()
+#define HTTP_DATE_SIZE 32	// buffer size for http_date()
 
-typedef enum 
+// content codings, as a bitmask; precompressed variants of "f" are
+// stored beside it as "f.gz" and "f.br"
+enum {
+    HTTP_ENCODING_IDENTITY = 0,
+    HTTP_ENCODING_GZIP = 1,
+    HTTP_ENCODING_BR = 2
+};
+
+typedef enum
 {
     HTTP_VERSION_1_0,
     HTTP_VERSION_1_1,
 } http_version;
 
 
+// One http_request is kept per connection. Its input buffer lives as long
+// as the connection, so bytes that arrive with one request and belong to
+// the next (pipelining) are parsed on the next http_parse() call.
+
 struct http_request
 {
-    char url[80];
-    http_version version;
-    int socket;
+    // per-connection state
+    tamer::fd fd;
+    tamer::buffer in;
     int closed;
+
+    // the current request
+    std::string url;		// path with a leading '.', as "./index.html"
+    http_version version;
+    int keep_alive;
+    long long content_length;	// -1 if absent
+    time_t if_modified_since;	// 0 if absent
+    std::string if_none_match;	// raw header value, empty if absent
+    std::string if_range;	// raw header value, empty if absent
+    int accept_encoding;	// HTTP_ENCODING_* bits the client accepts
+    int has_range;
+    long long range_first;	// -1 for a suffix range ("bytes=-N")
+    long long range_last;	// -1 if open-ended ("bytes=N-")
+
+    http_request()
+	: in(1024) {
+    }
 };
 
-void http_init(http_request *req, int socket);
+void http_init(http_request *req, tamer::fd f);
 
+// Read and parse the next request on the connection. Triggers @a ev with
+// 1 for a valid GET request and 0 otherwise; sets req->closed when the
+// connection has ended or can no longer be parsed.
 void http_parse(http_request *req, tamer::event<int> ev);
 
+// Response validators for a file: a strong entity tag built from the
+// inode, size and modification time, and an HTTP date.
+void http_etag(const struct stat &st, char *buf);
+void http_date(time_t t, char *buf);
+
+// The Content-Type for @a filename, from its extension.
+const char *http_mime_type(const char *filename);
+
+// The filename suffix and extra response header lines for @a encoding.
+// @a vary is true if the resource has precompressed variants, in which
+// case the headers include "Vary: Accept-Encoding".
+const char *http_encoding_suffix(int encoding);
+const char *http_encoding_headers(int encoding, bool vary);
+
+// The HTTP_ENCODING_* mask of @a filename's precompressed siblings that
+// are regular files at least as new as @a st, the file itself.
+int http_find_variants(const char *filename, const struct stat &st);
+
+// The best of the @a available encodings that @a req accepts (brotli
+// over gzip), or HTTP_ENCODING_IDENTITY.
+int http_choose_encoding(const http_request *req, int available);
+
+// Decide how to answer @a req for an entity of @a size bytes with the
+// given validators, following RFC 7232/7233: returns 304 if the client's
+// copy is current, 206 for a satisfiable Range (setting [@a first,
+// @a first + @a len) to the bytes to send), 416 for an unsatisfiable one,
+// and 200 otherwise (with the whole entity in @a first and @a len).
+int http_select(const http_request *req, const char *etag, time_t mtime,
+		off_t size, off_t &first, off_t &len);
+
 #endif
@@ -1,13 +1,39 @@
 #ifndef HTTPHDRS_H
 #define HTTPHDRS_H
 
-#define HEADER_200_BUF_SIZE 128
+#define HEADER_200_BUF_SIZE 384
 #define HEADER_200 ("HTTP/1.1 200 OK\r\n" \
                     "Content-Type: %s\r\n" \
+                    "%s" \
                     "Content-Length: %ld\r\n" \
+                    "ETag: %s\r\n" \
+                    "Last-Modified: %s\r\n" \
+                    "Accept-Ranges: bytes\r\n" \
+                    "\r\n")
+
+#define HEADER_206 ("HTTP/1.1 206 Partial Content\r\n" \
+                    "Content-Type: %s\r\n" \
+                    "%s" \
+                    "Content-Length: %ld\r\n" \
+                    "Content-Range: bytes %ld-%ld/%ld\r\n" \
+                    "ETag: %s\r\n" \
+                    "Last-Modified: %s\r\n" \
+                    "\r\n")
+
+#define HEADER_304 ("HTTP/1.1 304 Not Modified\r\n" \
+                    "%s" \
+                    "ETag: %s\r\n" \
+                    "Last-Modified: %s\r\n" \
+                    "\r\n")
+
+#define HEADER_416 ("HTTP/1.1 416 Range Not Satisfiable\r\n" \
+                    "Content-Length: 0\r\n" \
+                    "Content-Range: bytes */%ld\r\n" \
                     "\r\n")
 
 #define HEADER_404 ("HTTP/1.1 404 Not Found\r\n" \
-                    "Connection: close\r\n")
+                    "Content-Length: 0\r\n" \
+                    "Connection: close\r\n" \
+                    "\r\n")
 
 #endif
@@ -18,14 +18,117 @@
 #include <tamer/fd.hh>
 namespace tamer {
 
+/** @class buffer_view tamer/bufferedio.hh <tamer/bufferedio.hh>
+ *  @brief  A read-only view of bytes in a buffer.
+ *
+ *  buffer is a ring, so a view has up to two parts: data[0] holds the first
+ *  length[0] bytes and data[1] the remaining length[1] bytes.  length[1] is
+ *  zero when the bytes are contiguous.
+ */
+struct buffer_view {
+    const char *data[2];
+    size_t length[2];
+
+    buffer_view() {
+	data[0] = data[1] = 0;
+	length[0] = length[1] = 0;
+    }
+
+    /** @brief  Return the number of bytes in the view. */
+    size_t size() const {
+	return length[0] + length[1];
+    }
+
+    /** @brief  Test if the view is a single contiguous range. */
+    bool contiguous() const {
+	return length[1] == 0;
+    }
+
+    /** @brief  Return the bytes as a string. */
+    std::string str() const {
+	std::string s;
+	s.reserve(size());
+	s.append(data[0], length[0]);
+	s.append(data[1], length[1]);
+	return s;
+    }
+};
+
 class buffer { public:
 
     buffer(size_t initial_capacity = 1024);
     ~buffer();
 
+    /** @brief  Read from @a f until the buffer contains @a c.
+     *  @param       f         File descriptor.
+     *  @param       c         Delimiter.
+     *  @param       max_size  Maximum record size, including delimiter.
+     *  @param[out]  out_size  Size of the record, including delimiter.
+     *  @param       done      Event triggered on completion.
+     *
+     *  Does not consume the record; use view() and consume() to examine it
+     *  in place, or take_until() to copy it out.  @a done is triggered with
+     *  0 on success, -E2BIG if no delimiter appears within @a max_size
+     *  bytes, or a negative error code. */
     void fill_until(fd f, char c, size_t max_size, size_t &out_size, event<int> done);
+
+    /** @brief  Read a record ending with @a c into @a str and consume it. */
     void take_until(fd f, char c, size_t max_size, std::string &str, event<int> done);
 
+    /** @brief  Read from @a f until the buffer contains @a delim.
+     *
+     *  Like fill_until(fd, char, size_t, size_t &, event<int>), but the
+     *  delimiter may be several bytes long, such as "\r\n" or
+     *  "\r\n\r\n".  Bytes ruled out by one scan are not examined again
+     *  when more data arrives. */
+    void fill_until(fd f, const std::string &delim, size_t max_size,
+		    size_t &out_size, event<int> done);
+
+    /** @brief  Read from @a f until at least @a size bytes are buffered.
+     *
+     *  @a done is triggered with 0 on success, or a negative error code. */
+    void fill(fd f, size_t size, event<int> done);
+
+    /** @brief  Formats for frame length prefixes. */
+    enum length_format {
+	u16be, u16le, u32be, u32le,	///< fixed-width unsigned integers
+	varint				///< base-128, low-order group first
+    };
+
+    /** @brief  Read from @a f until the buffer contains a whole
+     *  length-prefixed frame.
+     *  @param       f            File descriptor.
+     *  @param       format       Format of the length prefix.
+     *  @param       max_size     Maximum frame size, including prefix.
+     *  @param[out]  prefix_size  Size of the length prefix.
+     *  @param[out]  out_size     Size of the frame, including prefix.
+     *  @param       done         Event triggered on completion.
+     *
+     *  The payload is the @a out_size - @a prefix_size bytes following the
+     *  prefix.  Does not consume the frame.  @a done is triggered with 0 on
+     *  success, -E2BIG if the frame would exceed @a max_size, -EINVAL for
+     *  an overlong varint, or a negative error code. */
+    void fill_frame(fd f, length_format format, size_t max_size,
+		    size_t &prefix_size, size_t &out_size, event<int> done);
+
+    /** @brief  Return the number of buffered bytes. */
+    size_t size() const {
+	return _tail - _head;
+    }
+
+    /** @brief  Return a view of the first @a size buffered bytes.
+     *  @pre  @a size <= size()
+     *
+     *  The view stays valid until the next consume() or fill. */
+    buffer_view view(size_t size) const;
+
+    /** @brief  Discard the first @a size buffered bytes.
+     *  @pre  @a size <= size() */
+    void consume(size_t size) {
+	assert(size <= _tail - _head);
+	_head += size;
+    }
+
   private:
 
     char *_buf;
@@ -33,12 +136,102 @@ class buffer { public:
     size_t _head;
     size_t _tail;
 
+    static size_t garbage_size;
+
+    // Incremental record scanner. Offsets are relative to _head, which
+    // moves only when fill_more() grows the ring.
+    struct framer {
+	enum { delimited, fixed, prefixed } kind;
+	std::string delim;
+	size_t size;		// fixed: record size
+	int format;		// prefixed: length_format
+	size_t off;		// first offset not yet ruled out
+	size_t prefix;		// prefixed: prefix size, once known
+	uint64_t length;	// prefixed: payload length so far
+
+	framer()
+	    : kind(fixed), size(0), format(0), off(0), prefix(0), length(0) {
+	}
+    };
+
     ssize_t fill_more(fd f, const event<int> &done);
+    size_t find(char c, size_t pos, size_t end) const;
+    unsigned char at(size_t off) const {
+	return _buf[(_head + off) & (_size - 1)];
+    }
+    ssize_t scan(framer &fr, size_t max_size) const;
+    void fill_framed(fd f, framer fr, size_t max_size, size_t &out_size,
+		     size_t &prefix_size, event<int> done);
 
     class closure__fill_until__2fdckRkQi_;
     void fill_until(closure__fill_until__2fdckRkQi_ &);
     class closure__take_until__2fdckRSsQi_;
     void take_until(closure__take_until__2fdckRSsQi_ &);
+    class closure__fill_framed__2fd6framerkRkRkQi_;
+    void fill_framed(closure__fill_framed__2fd6framerkRkRkQi_ &);
+
+};
+
+namespace tamerpriv {
+struct outbuffer_imp;
+}
+
+/** @class outbuffer tamer/bufferedio.hh <tamer/bufferedio.hh>
+ *  @brief  Coalescing output buffer for a file descriptor.
+ *
+ *  An outbuffer collects small writes in memory and sends them to its file
+ *  descriptor in a single system call.  Buffered data is flushed
+ *  automatically at the end of the current driver iteration, or as soon as
+ *  it reaches the flush threshold, so a protocol that emits many small
+ *  messages in one pass (say, responses to pipelined requests) pays for
+ *  one write instead of many.
+ *
+ *  outbuffer objects are reference-counted handles; copies share the same
+ *  buffer.  Data written before a flush() is sent before that flush's
+ *  event is triggered.  Once a write fails, later data is discarded and
+ *  error() returns the error code.
+ */
+class outbuffer { public:
+
+    /** @brief  Construct an empty outbuffer that discards its data. */
+    outbuffer();
+
+    /** @brief  Construct an outbuffer for @a f.
+     *  @param  f          File descriptor.
+     *  @param  threshold  Buffered byte count that triggers a flush. */
+    explicit outbuffer(const fd &f, size_t threshold = 65536);
+
+    outbuffer(const outbuffer &x);
+    ~outbuffer();
+    outbuffer &operator=(const outbuffer &x);
+
+    /** @brief  Append @a size bytes from @a buf. */
+    void write(const void *buf, size_t size);
+
+    /** @brief  Append the contents of @a str. */
+    inline void write(const std::string &str) {
+	write(str.data(), str.length());
+    }
+
+    /** @brief  Send buffered data now.
+     *  @param  done  Event triggered once all previously written data has
+     *                been sent.
+     *
+     *  @a done is triggered with 0 on success, or a negative error code. */
+    void flush(event<int> done);
+
+    /** @brief  Send buffered data now, without waiting for the result. */
+    void flush();
+
+    /** @brief  Return the number of bytes buffered but not yet sent. */
+    size_t pending() const;
+
+    /** @brief  Return the first write error, or 0. */
+    int error() const;
+
+  private:
+
+    ref_ptr<tamerpriv::outbuffer_imp> _p;
 
 };
 
@@ -13,31 +13,103 @@
  */
 #include "config.h"
 #include <tamer/tamer.hh>
+#include "dinternal.hh"
 #include <sys/select.h>
 #include <stdio.h>
 #include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#if HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
 
 namespace tamer {
 
-driver *driver::main;
+TAMER_THREAD_LOCAL driver *driver::main;
 
-void initialize()
+void initialize(int flags)
 {
-    if (!driver::main && !getenv("TAMER_NOLIBEVENT"))
+    if (!driver::main && (flags & use_io_uring))
+	driver::main = driver::make_io_uring(flags);
+    if (!driver::main
+	&& ((flags & use_libevent)
+	    || (!(flags & (use_tamer | use_epoll | use_io_uring))
+		&& !getenv("TAMER_NOLIBEVENT"))))
 	driver::main = driver::make_libevent();
+    if (!driver::main
+	&& ((flags & use_epoll)
+	    || (!(flags & use_tamer) && !getenv("TAMER_NOEPOLL"))))
+	driver::main = driver::make_epoll(flags);
     if (!driver::main)
-	driver::main = driver::make_tamer();
+	driver::main = driver::make_tamer(flags);
 }
 
 void cleanup()
 {
+    if (driver::sig_driver == driver::main)
+	driver::sig_driver = 0;
     delete driver::main;
     driver::main = 0;
 }
 
+namespace {
+struct loop_thread_info {
+    int index;
+    int flags;
+    void (*start)(int, void *);
+    void *arg;
+};
+
+extern "C" void *loop_thread(void *x)
+{
+    loop_thread_info *info = static_cast<loop_thread_info *>(x);
+    initialize(info->flags);
+    info->start(info->index, info->arg);
+    loop();
+    return 0;
+}
+}
+
+int loop_threads(int nloops, void (*start)(int, void *), void *arg, int flags)
+{
+    if (nloops <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	nloops = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nloops <= 0)
+	    nloops = 1;
+    }
+    // libevent keeps global state, so every loop gets a native driver
+    flags &= ~use_libevent;
+    if (!(flags & (use_tamer | use_epoll | use_io_uring)))
+	flags |= use_epoll;
+
+    loop_thread_info *info = new loop_thread_info[nloops];
+    for (int i = 0; i < nloops; ++i) {
+	info[i].index = i;
+	info[i].flags = flags;
+	info[i].start = start;
+	info[i].arg = arg;
+    }
+#if HAVE_PTHREAD_H
+    for (int i = 1; i < nloops; ++i) {
+	pthread_t thread;
+	int r = pthread_create(&thread, 0, loop_thread, &info[i]);
+	if (r != 0)
+	    return -r;
+	pthread_detach(thread);
+    }
+#else
+    if (nloops > 1)
+	return -ENOSYS;
+#endif
+    loop_thread(&info[0]);
+    return 0;
+}
+
 void driver::at_delay(double delay, const event<> &e)
 {
     if (delay <= 0)
@@ -74,4 +146,279 @@ void driver::at_delay(double delay, event<> &&e)
 }
 #endif
 
+
+namespace tamerpriv {
+
+driver_asapset::~driver_asapset()
+{
+    // destroy all active asaps
+    while (head_ != tail_) {
+	simple_event::unuse(ses_[head_ & capmask_]);
+	++head_;
+    }
+    delete[] ses_;
+}
+
+void driver_asapset::expand()
+{
+    unsigned ncapmask = (capmask_ + 1 ? ((capmask_ + 1) * 4 - 1) : 31);
+    simple_event **na = new simple_event *[ncapmask + 1];
+    unsigned i = 0;
+    for (unsigned x = head_; x != tail_; ++x, ++i)
+	na[i] = ses_[x & capmask_];
+    delete[] ses_;
+    ses_ = na;
+    capmask_ = ncapmask;
+    head_ = 0;
+    tail_ = i;
+}
+
+
+driver_timerheap::driver_timerheap()
+    : t_(0), nt_(0), tcap_(0), torder_(0)
+{
+    expand();
+}
+
+driver_timerheap::~driver_timerheap()
+{
+    // destroy all active timers
+    for (int i = 0; i < nt_; i++)
+	simple_event::unuse(t_[i].trigger_);
+    delete[] reinterpret_cast<char *>(t_);
+}
+
+void driver_timerheap::expand()
+{
+    int ntcap = (tcap_ ? ((tcap_ + 1) * 2 - 1) : 511);
+    ttimer *nt = reinterpret_cast<ttimer *>(new char[sizeof(ttimer) * ntcap]);
+    if (nt_ != 0)
+	// take advantage of fact that memcpy() works on event<>
+	memcpy(nt, t_, sizeof(ttimer) * nt_);
+    delete[] reinterpret_cast<char *>(t_);
+    t_ = nt;
+    tcap_ = ntcap;
+}
+
+void driver_timerheap::reheapify_from(int pos)
+{
+    int npos;
+    while (pos > 0
+	   && (npos = (pos - 1) >> 1, t_[npos] > t_[pos])) {
+	std::swap(t_[pos], t_[npos]);
+	pos = npos;
+    }
+
+    while (1) {
+	int smallest = pos;
+	npos = 2*pos + 1;
+	if (npos < nt_ && t_[smallest] > t_[npos])
+	    smallest = npos;
+	if (npos + 1 < nt_ && t_[smallest] > t_[npos + 1])
+	    smallest = npos + 1, ++npos;
+	if (smallest == pos)
+	    break;
+	std::swap(t_[pos], t_[smallest]);
+	pos = smallest;
+    }
+}
+
+void driver_timerheap::pop()
+{
+    --nt_;
+    if (nt_ != 0) {
+	t_[0] = t_[nt_];
+	reheapify_from(0);
+    }
+}
+
+void driver_timerheap::run(const timeval &now)
+{
+    while (nt_ != 0 && !timercmp(&t_[0].expiry_, &now, >)) {
+	simple_event *trigger = t_[0].trigger_;
+	pop();
+	trigger->simple_trigger(false);
+    }
+}
+
+
+driver_timerwheel::driver_timerwheel()
+    : cur_(0), nt_(0), ncap_(0), free_(0), dead_(0), groups_(0),
+      cancelr_(this)
+{
+    for (int l = 0; l < nlevels; ++l) {
+	for (int i = 0; i < wsize; ++i) {
+	    slots_[l][i].head_ = 0;
+	    slots_[l][i].ptail_ = &slots_[l][i].head_;
+	}
+	occupied_[l] = 0;
+    }
+    overflow_.head_ = 0;
+    overflow_.ptail_ = &overflow_.head_;
+    timeval now;
+    gettimeofday(&now, 0);
+    cur_ = now.tv_sec * (uint64_t) 1000 + now.tv_usec / 1000;
+}
+
+driver_timerwheel::~driver_timerwheel()
+{
+    // destroy all active timers, unlinking each first, as run() does
+    for (int l = 0; l <= nlevels; ++l)
+	for (int i = 0; i < (l < nlevels ? wsize : 1); ++i) {
+	    wslot &s = (l < nlevels ? slots_[l][i] : overflow_);
+	    while (wtimer *t = s.head_) {
+		unlink(t);
+		simple_event *trigger = t->trigger_;
+		t->trigger_ = 0;
+		simple_event::unuse(trigger);
+	    }
+	}
+    reclaim();
+    while (groups_) {
+	wtimer_group *next = groups_->next;
+	delete[] reinterpret_cast<unsigned char *>(groups_);
+	groups_ = next;
+    }
+}
+
+void driver_timerwheel::expand()
+{
+    int ncap = (ncap_ ? ncap_ * 2 : 512);
+    wtimer_group *ngroup = reinterpret_cast<wtimer_group *>(new unsigned char[sizeof(wtimer_group) + sizeof(wtimer) * (ncap - 1)]);
+    ngroup->next = groups_;
+    groups_ = ngroup;
+    for (int i = 0; i < ncap; ++i) {
+	ngroup->t[i].next_ = free_;
+	free_ = &ngroup->t[i];
+    }
+    ncap_ += ncap;
+}
+
+void driver_timerwheel::wcancel::hook(functional_rendezvous *fr,
+				      simple_event *e, bool) TAMER_NOEXCEPT
+{
+    // Runs for every timer's event, canceled or fired; run() clears
+    // trigger_ before firing, so here a live trigger_ means cancellation.
+    driver_timerwheel *w = static_cast<wcancel *>(fr)->wheel_;
+    wtimer *t = reinterpret_cast<wtimer *>(e->rid());
+    if (t->trigger_) {
+	w->unlink(t);
+	t->next_ = w->dead_;
+	w->dead_ = t;
+	--w->nt_;
+    }
+}
+
+void driver_timerwheel::reclaim()
+{
+    while (wtimer *t = dead_) {
+	dead_ = t->next_;
+	simple_event::unuse(t->trigger_);
+	t->next_ = free_;
+	free_ = t;
+    }
+}
+
+static inline int first_bit(uint64_t x)
+{
+#if __GNUC__
+    return __builtin_ctzll(x);
+#else
+    int i = 0;
+    while (!(x & 1))
+	x >>= 1, ++i;
+    return i;
+#endif
+}
+
+bool driver_timerwheel::first_slot(int &level, int &idx, uint64_t &tick) const
+{
+    // Lower levels always expire first: every occupied slot at level L
+    // lies after the current block of level L - 1.
+    for (int l = 0; l < nlevels; ++l) {
+	int shift = l * wbits;
+	uint64_t bits = occupied_[l] & (~(uint64_t) 0 << ((cur_ >> shift) & (wsize - 1)));
+	if (bits) {
+	    level = l;
+	    idx = first_bit(bits);
+	    tick = ((cur_ >> (shift + wbits)) << (shift + wbits))
+		| ((uint64_t) idx << shift);
+	    if (tick < cur_)
+		tick = cur_;
+	    return true;
+	}
+    }
+    if (overflow_.head_) {
+	int shift = nlevels * wbits;
+	level = nlevels;
+	idx = 0;
+	tick = ((cur_ >> shift) + 1) << shift;
+	return true;
+    }
+    return false;
+}
+
+const timeval &driver_timerwheel::expiry()
+{
+    int level, idx;
+    uint64_t tick;
+    if (first_slot(level, idx, tick)) {
+	expiry_.tv_sec = tick / 1000;
+	expiry_.tv_usec = (tick % 1000) * 1000;
+    }
+    return expiry_;
+}
+
+void driver_timerwheel::run(const timeval &now)
+{
+    uint64_t ntick = now.tv_sec * (uint64_t) 1000 + now.tv_usec / 1000;
+    int level, idx;
+    uint64_t tick;
+    while (first_slot(level, idx, tick) && tick <= ntick) {
+	cur_ = tick;
+	wslot &s = (level < nlevels ? slots_[level][idx] : overflow_);
+	if (level == 0)
+	    // Take timers off one at a time: triggering one may cancel (and
+	    // so unlink) any other. Free each only after its trigger, so its
+	    // at_trigger sees a fired timer rather than one reused by push().
+	    while (wtimer *t = s.head_) {
+		unlink(t);
+		simple_event *trigger = t->trigger_;
+		t->trigger_ = 0;
+		trigger->simple_trigger(false);
+		free_timer(t);
+	    }
+	else {
+	    // cascade into lower levels; nothing triggers here
+	    wtimer *t = s.head_;
+	    s.head_ = 0;
+	    s.ptail_ = &s.head_;
+	    if (level < nlevels)
+		occupied_[level] &= ~((uint64_t) 1 << idx);
+	    while (t) {
+		wtimer *next = t->next_;
+		insert(t);
+		t = next;
+	    }
+	}
+    }
+    // no timer expires before ntick, so the wheel can jump ahead
+    if (ntick > cur_)
+	cur_ = ntick;
+}
+
+
+driver_timerset::driver_timerset(bool wheel)
+    : heap_(wheel ? 0 : new driver_timerheap),
+      wheel_(wheel ? new driver_timerwheel : 0)
+{
+}
+
+driver_timerset::~driver_timerset()
+{
+    delete heap_;
+    delete wheel_;
+}
+
+} // namespace tamer::tamerpriv
 }
@@ -0,0 +1,432 @@
+/* Copyright (c) 2007-2012, Eddie Kohler
+ * Copyright (c) 2007, Regents of the University of California
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include "config.h"
+#include <tamer/tamer.hh>
+#include "dinternal.hh"
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <string.h>
+#endif
+
+namespace tamer {
+#if HAVE_SYS_EPOLL_H
+namespace {
+
+class driver_epoll : public driver { public:
+
+    driver_epoll(int epfd, int flags);
+    ~driver_epoll();
+
+    virtual void store_fd(int fd, int action, tamerpriv::simple_event *se,
+			  int *slot);
+    virtual void store_time(const timeval &expiry, tamerpriv::simple_event *se);
+    virtual void store_asap(tamerpriv::simple_event *se);
+    virtual void kill_fd(int fd);
+
+    virtual bool empty();
+    virtual void once();
+    virtual void loop();
+    virtual const char *name() const {
+	return "epoll";
+    }
+
+  private:
+
+    struct tfd {
+	tamerpriv::simple_event *se;
+	int *slot;
+	tfd *next;
+    };
+
+    struct tfd_group {
+	tfd_group *next;
+	tfd t[1];
+    };
+
+    // Per-descriptor state, indexed by file descriptor. The kernel's
+    // interest set lags behind the waiters: a descriptor stays registered
+    // after its waiters trigger or are canceled and is only pruned if it
+    // reports readiness nobody wants. This saves two epoll_ctl()s per
+    // read/at_fd_read cycle. The kernel drops a registration silently when
+    // the descriptor is closed, so descriptors must be closed through
+    // kill_fd() first, as fd::close() does; otherwise a reused descriptor
+    // number would never be re-added.
+    struct epfd {
+	tfd *w[2];		// waiters, indexed by fdread/fdwrite
+	uint32_t interest;	// events registered with the kernel
+	bool registered;
+	bool always;		// kernel refused, e.g. regular file
+    };
+
+    enum { nevents = 256 };
+
+    int epfd_;
+    epfd *fds_;
+    int fdcap_;
+    int nwaiting_;
+    int nalways_;
+    bool sig_registered_;
+
+    tamerpriv::driver_timerset timers_;
+    tamerpriv::driver_asapset asap_;
+
+    int _fdcap;
+    tfd_group *_fdgroup;
+    tfd *_fdfree;
+    rendezvous<int> _fdcancelr;
+
+    epoll_event events_[nevents];
+
+    void expand_fds();
+    void expand_fdstate(int fd);
+    void update_interest(int fd);
+    void cull_fd(int fd);
+    void reap_canceled();
+    void trigger_list(tfd *t, int result);
+
+};
+
+
+driver_epoll::driver_epoll(int epfd, int flags)
+    : epfd_(epfd), fds_(0), fdcap_(0), nwaiting_(0), nalways_(0),
+      sig_registered_(false),
+      timers_(flags & use_timer_wheel), _fdcap(0), _fdgroup(0), _fdfree(0)
+{
+    set_now();
+}
+
+driver_epoll::~driver_epoll()
+{
+    // destroy all active file descriptors
+    for (int fd = 0; fd < fdcap_; ++fd)
+	for (int action = 0; action < 2; ++action)
+	    for (tfd *t = fds_[fd].w[action]; t; t = t->next)
+		tamerpriv::simple_event::unuse(t->se);
+    delete[] fds_;
+
+    // free file descriptor groups
+    while (_fdgroup) {
+	tfd_group *next = _fdgroup->next;
+	delete[] reinterpret_cast<unsigned char *>(_fdgroup);
+	_fdgroup = next;
+    }
+
+    ::close(epfd_);
+}
+
+void driver_epoll::expand_fds()
+{
+    int ncap = (_fdcap ? _fdcap * 2 : 16);
+
+    tfd_group *ngroup = reinterpret_cast<tfd_group *>(new unsigned char[sizeof(tfd_group) + sizeof(tfd) * (ncap - 1)]);
+    ngroup->next = _fdgroup;
+    _fdgroup = ngroup;
+    for (int i = 0; i < ncap; i++) {
+	ngroup->t[i].next = _fdfree;
+	_fdfree = &ngroup->t[i];
+    }
+    _fdcap += ncap;
+}
+
+void driver_epoll::expand_fdstate(int fd)
+{
+    int ncap = (fdcap_ ? fdcap_ * 2 : 256);
+    while (ncap <= fd)
+	ncap *= 2;
+    epfd *nfds = new epfd[ncap];
+    if (fdcap_)
+	memcpy(nfds, fds_, sizeof(epfd) * fdcap_);
+    memset(nfds + fdcap_, 0, sizeof(epfd) * (ncap - fdcap_));
+    delete[] fds_;
+    fds_ = nfds;
+    fdcap_ = ncap;
+}
+
+void driver_epoll::update_interest(int fd)
+{
+    epfd &ef = fds_[fd];
+    uint32_t want = (ef.w[fdread] ? (uint32_t) EPOLLIN : 0)
+	| (ef.w[fdwrite] ? (uint32_t) EPOLLOUT : 0);
+    if (ef.always || want == ef.interest)
+	return;
+
+    epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = want;
+    ev.data.fd = fd;
+    int r;
+    if (!want)
+	r = epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, &ev);
+    else if (!ef.registered) {
+	r = epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+	if (r == -1 && errno == EEXIST)
+	    r = epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+    } else {
+	r = epoll_ctl(epfd_, EPOLL_CTL_MOD, fd, &ev);
+	// the kernel silently drops closed descriptors
+	if (r == -1 && errno == ENOENT)
+	    r = epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    if (r == 0 || !want) {
+	ef.interest = want;
+	ef.registered = (want != 0);
+    } else if (errno == EPERM) {
+	// epoll refuses regular files; like select(), call them always ready
+	ef.always = true;
+	ef.interest = 0;
+	ef.registered = false;
+	++nalways_;
+    }
+}
+
+void driver_epoll::store_fd(int fd, int action, tamerpriv::simple_event *se,
+			    int *slot)
+{
+    assert(fd >= 0 && (action == fdread || action == fdwrite));
+    if (se && *se) {
+	if (!_fdfree)
+	    expand_fds();
+	if (fd >= fdcap_)
+	    expand_fdstate(fd);
+
+	tfd *t = _fdfree;
+	_fdfree = t->next;
+	t->se = se;
+	t->slot = slot;
+	t->next = fds_[fd].w[action];
+	fds_[fd].w[action] = t;
+	++nwaiting_;
+
+	update_interest(fd);
+	tamerpriv::simple_event::at_trigger(se, event<>(_fdcancelr, fd).__take_simple());
+    } else
+	tamerpriv::simple_event::unuse_clean(se);
+}
+
+void driver_epoll::trigger_list(tfd *t, int result)
+{
+    // The list has already been detached from fds_, so triggered events may
+    // safely register new waiters (even if that reallocates fds_).
+    while (t) {
+	if (*t->se && t->slot)
+	    *t->slot = result;
+	t->se->simple_trigger(true);
+	--nwaiting_;
+	tfd *next = t->next;
+	t->next = _fdfree;
+	_fdfree = t;
+	t = next;
+    }
+}
+
+void driver_epoll::kill_fd(int fd)
+{
+    assert(fd >= 0);
+    if (fd >= fdcap_)
+	return;
+    epfd &ef = fds_[fd];
+    tfd *r = ef.w[fdread], *w = ef.w[fdwrite];
+    if (ef.registered)
+	(void) epoll_ctl(epfd_, EPOLL_CTL_DEL, fd, 0);
+    if (ef.always)
+	--nalways_;
+    memset(&ef, 0, sizeof(ef));
+    trigger_list(r, -ECANCELED);
+    trigger_list(w, -ECANCELED);
+}
+
+void driver_epoll::cull_fd(int fd)
+{
+    epfd &ef = fds_[fd];
+    for (int action = 0; action < 2; ++action) {
+	tfd **pprev = &ef.w[action], *t;
+	while ((t = *pprev))
+	    if (!*t->se) {
+		tamerpriv::simple_event::unuse_clean(t->se);
+		--nwaiting_;
+		*pprev = t->next;
+		t->next = _fdfree;
+		_fdfree = t;
+	    } else
+		pprev = &t->next;
+    }
+    if (ef.always && !ef.w[fdread] && !ef.w[fdwrite]) {
+	ef.always = false;
+	--nalways_;
+    }
+}
+
+void driver_epoll::reap_canceled()
+{
+    // Notifiers fire both for canceled waiters and for triggered ones;
+    // culling a descriptor with no dead waiters is cheap.
+    int fd;
+    while (_fdcancelr.join(fd))
+	if (fd < fdcap_)
+	    cull_fd(fd);
+}
+
+void driver_epoll::store_time(const timeval &expiry,
+			      tamerpriv::simple_event *se)
+{
+    if (se)
+	timers_.push(expiry, se);
+}
+
+void driver_epoll::store_asap(tamerpriv::simple_event *se)
+{
+    if (se)
+	asap_.push(se);
+}
+
+bool driver_epoll::empty()
+{
+    timers_.cull();
+    if (_fdcancelr.has_ready())
+	reap_canceled();
+    if (!asap_.empty()
+	|| !timers_.empty()
+	|| sig_pending()
+	|| tamerpriv::abstract_rendezvous::has_unblocked()
+	|| nwaiting_ != 0)
+	return false;
+    return true;
+}
+
+void driver_epoll::once()
+{
+    // get rid of canceled descriptors, if any
+    if (_fdcancelr.has_ready())
+	reap_canceled();
+
+    // determine timeout
+    timers_.cull();
+    int timeout;
+    if (!asap_.empty()
+	|| (!timers_.empty() && !timercmp(&timers_.expiry(), &now, >))
+	|| sig_pending()
+	|| tamerpriv::abstract_rendezvous::has_unblocked()
+	|| nalways_ != 0)
+	timeout = 0;
+    else if (timers_.empty())
+	timeout = -1;
+    else {
+	timeval to;
+	timersub(&timers_.expiry(), &now, &to);
+	// round up so we don't spin until the timer expires
+	if (to.tv_sec >= 1000000)
+	    timeout = 1000000000;
+	else
+	    timeout = to.tv_sec * 1000 + (to.tv_usec + 999) / 1000;
+    }
+
+    // make sure signals wake us up
+    if (sig_fd() >= 0 && !sig_registered_) {
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.fd = sig_pipe[0];
+	if (epoll_ctl(epfd_, EPOLL_CTL_ADD, sig_pipe[0], &ev) == 0
+	    || errno == EEXIST)
+	    sig_registered_ = true;
+    }
+
+    // epoll!
+    int nev = 0;
+    if (nwaiting_ != 0 || sig_registered_ || timeout > 0)
+	nev = epoll_wait(epfd_, events_, nevents, timeout);
+
+    // run signals
+    if (sig_pending())
+	dispatch_signals();
+
+    // run asaps
+    asap_.run();
+
+    // run file descriptors
+    for (int i = 0; i < nev; ++i) {
+	int fd = events_[i].data.fd;
+	if (fd == sig_pipe[0] || fd >= fdcap_)
+	    continue;
+	uint32_t x = events_[i].events;
+	if (x & (EPOLLERR | EPOLLHUP))
+	    x |= EPOLLIN | EPOLLOUT;
+	tfd *r = 0, *w = 0;
+	if (x & EPOLLIN) {
+	    r = fds_[fd].w[fdread];
+	    fds_[fd].w[fdread] = 0;
+	}
+	if (x & EPOLLOUT) {
+	    w = fds_[fd].w[fdwrite];
+	    fds_[fd].w[fdwrite] = 0;
+	}
+	// readiness that nobody wanted: stop listening for it
+	if ((!r && (events_[i].events & EPOLLIN))
+	    || (!w && (events_[i].events & EPOLLOUT)))
+	    update_interest(fd);
+	trigger_list(r, 0);
+	trigger_list(w, 0);
+    }
+    if (nalways_ != 0)
+	for (int fd = 0; fd < fdcap_; ++fd)
+	    if (fds_[fd].always) {
+		tfd *r = fds_[fd].w[fdread], *w = fds_[fd].w[fdwrite];
+		fds_[fd].w[fdread] = fds_[fd].w[fdwrite] = 0;
+		fds_[fd].always = false;
+		--nalways_;
+		trigger_list(r, 0);
+		trigger_list(w, 0);
+	    }
+
+    // run the timers that worked
+    if (!timers_.empty()) {
+	set_now();
+	timers_.run(now);
+    }
+
+    // run active closures
+    while (tamerpriv::abstract_rendezvous *r = tamerpriv::abstract_rendezvous::pop_unblocked())
+	r->run();
+}
+
+void driver_epoll::loop()
+{
+    while (1)
+	once();
+}
+
+}
+
+driver *driver::make_epoll(int flags)
+{
+    int epfd = epoll_create(1024);
+    if (epfd < 0)
+	return 0;
+    fcntl(epfd, F_SETFD, FD_CLOEXEC);
+    return new driver_epoll(epfd, flags);
+}
+
+#else
+
+driver *driver::make_epoll(int)
+{
+    return 0;
+}
+
+#endif
+}
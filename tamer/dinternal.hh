@@ -0,0 +1,304 @@
+#ifndef TAMER_DINTERNAL_HH
+#define TAMER_DINTERNAL_HH 1
+/* Copyright (c) 2007-2012, Eddie Kohler
+ * Copyright (c) 2007, Regents of the University of California
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <tamer/xdriver.hh>
+namespace tamer {
+namespace tamerpriv {
+
+// Timer and ASAP bookkeeping shared by the native drivers. Timers are kept
+// either in a binary heap (exact ordering, O(log n) insertion) or in a
+// hierarchical timing wheel (millisecond resolution, O(1) insertion and
+// cancellation).
+
+class driver_asapset { public:
+
+    inline driver_asapset();
+    ~driver_asapset();
+
+    inline bool empty() const {
+	return head_ == tail_;
+    }
+
+    inline void push(simple_event *se);
+    inline void run();
+
+  private:
+
+    simple_event **ses_;
+    unsigned head_;
+    unsigned tail_;
+    unsigned capmask_;
+
+    void expand();
+
+};
+
+class driver_timerheap { public:
+
+    driver_timerheap();
+    ~driver_timerheap();
+
+    inline bool empty() const {
+	return nt_ == 0;
+    }
+    inline const timeval &expiry() const {
+	return t_[0].expiry_;
+    }
+
+    inline void push(const timeval &expiry, simple_event *se);
+    inline void cull();
+    void run(const timeval &now);
+
+  private:
+
+    struct ttimer {
+	timeval expiry_;
+	unsigned order_;
+	simple_event *trigger_;
+	ttimer(const timeval &expiry, unsigned order, simple_event *trigger)
+	    : expiry_(expiry), order_(order), trigger_(trigger) {
+	}
+	bool operator>(const ttimer &x) const {
+	    if (expiry_.tv_sec != x.expiry_.tv_sec)
+		return expiry_.tv_sec > x.expiry_.tv_sec;
+	    if (expiry_.tv_usec != x.expiry_.tv_usec)
+		return expiry_.tv_usec > x.expiry_.tv_usec;
+	    return (int) (order_ - x.order_) > 0;
+	}
+    };
+
+    ttimer *t_;
+    int nt_;
+    int tcap_;
+    unsigned torder_;
+
+    void expand();
+    void reheapify_from(int pos);
+    void pop();
+
+};
+
+
+class driver_timerwheel { public:
+
+    driver_timerwheel();
+    ~driver_timerwheel();
+
+    inline bool empty() const {
+	return nt_ == 0;
+    }
+    const timeval &expiry();
+
+    inline void push(const timeval &expiry, simple_event *se);
+    inline void cull();
+    void run(const timeval &now);
+
+  private:
+
+    // Timers are kept in millisecond ticks. Level L has wsize slots, each
+    // covering wsize^L ticks; a timer lives in the lowest level whose
+    // current block contains its expiry, and moves down as time advances.
+    enum { wbits = 6, wsize = 1 << wbits, nlevels = 5 };
+
+    struct wslot;
+
+    struct wtimer {
+	uint64_t tick_;
+	simple_event *trigger_;	// null once run() has fired it
+	wtimer *next_;
+	wtimer **pprev_;
+	wslot *slot_;
+    };
+
+    struct wslot {
+	wtimer *head_;
+	wtimer **ptail_;
+    };
+
+    // Each timer's event has an at_trigger on this rendezvous, with the
+    // timer as its ID, so a canceled timer leaves its slot at once. It
+    // can't release the event there (a rendezvous clear() may still be
+    // walking it), so it waits on dead_ for cull().
+    class wcancel : public functional_rendezvous { public:
+	wcancel(driver_timerwheel *wheel)
+	    : functional_rendezvous(hook), wheel_(wheel) {
+	}
+	inline void add(simple_event *e, uintptr_t rid) {
+	    e->initialize(this, rid);
+	}
+      private:
+	driver_timerwheel *wheel_;
+	static void hook(functional_rendezvous *fr, simple_event *e,
+			 bool values) TAMER_NOEXCEPT;
+    };
+
+    struct wtimer_group {
+	wtimer_group *next;
+	wtimer t[1];
+    };
+
+    wslot slots_[nlevels][wsize];
+    uint64_t occupied_[nlevels];
+    wslot overflow_;
+    uint64_t cur_;
+    int nt_;
+    int ncap_;
+    wtimer *free_;
+    wtimer *dead_;
+    wtimer_group *groups_;
+    timeval expiry_;
+    wcancel cancelr_;
+
+    void expand();
+    void reclaim();
+    inline void insert(wtimer *t);
+    inline void unlink(wtimer *t);
+    inline void free_timer(wtimer *t);
+    bool first_slot(int &level, int &idx, uint64_t &tick) const;
+
+};
+
+class driver_timerset { public:
+
+    explicit driver_timerset(bool wheel = false);
+    ~driver_timerset();
+
+    inline bool empty() const {
+	return heap_ ? heap_->empty() : wheel_->empty();
+    }
+    inline const timeval &expiry() {
+	return heap_ ? heap_->expiry() : wheel_->expiry();
+    }
+
+    inline void push(const timeval &expiry, simple_event *se) {
+	if (heap_)
+	    heap_->push(expiry, se);
+	else
+	    wheel_->push(expiry, se);
+    }
+    inline void cull() {
+	if (heap_)
+	    heap_->cull();
+	else
+	    wheel_->cull();
+    }
+    inline void run(const timeval &now) {
+	if (heap_)
+	    heap_->run(now);
+	else
+	    wheel_->run(now);
+    }
+
+  private:
+
+    driver_timerheap *heap_;
+    driver_timerwheel *wheel_;
+
+};
+
+inline driver_asapset::driver_asapset()
+    : ses_(0), head_(0), tail_(0), capmask_(-1U) {
+}
+
+inline void driver_asapset::push(simple_event *se) {
+    if (tail_ - head_ == capmask_ + 1)
+	expand();
+    ses_[tail_ & capmask_] = se;
+    ++tail_;
+}
+
+inline void driver_asapset::run() {
+    while (head_ != tail_) {
+	simple_event *se = ses_[head_ & capmask_];
+	++head_;
+	se->simple_trigger(false);
+    }
+}
+
+inline void driver_timerheap::push(const timeval &expiry, simple_event *se) {
+    if (nt_ == tcap_)
+	expand();
+    (void) new(static_cast<void *>(&t_[nt_])) ttimer(expiry, ++torder_, se);
+    ++nt_;
+    reheapify_from(nt_ - 1);
+}
+
+inline void driver_timerheap::cull() {
+    while (nt_ != 0 && t_[0].trigger_->empty()) {
+	simple_event::unuse(t_[0].trigger_);
+	pop();
+    }
+}
+
+inline void driver_timerwheel::insert(wtimer *t) {
+    uint64_t tick = (t->tick_ > cur_ ? t->tick_ : cur_);
+    uint64_t x = tick ^ cur_;
+    int level = 0;
+    while (level < nlevels && (x >> ((level + 1) * wbits)) != 0)
+	++level;
+    wslot *s;
+    if (level == nlevels)
+	s = &overflow_;
+    else {
+	int idx = (tick >> (level * wbits)) & (wsize - 1);
+	s = &slots_[level][idx];
+	occupied_[level] |= (uint64_t) 1 << idx;
+    }
+    t->next_ = 0;
+    t->pprev_ = s->ptail_;
+    t->slot_ = s;
+    *s->ptail_ = t;
+    s->ptail_ = &t->next_;
+}
+
+inline void driver_timerwheel::unlink(wtimer *t) {
+    wslot *s = t->slot_;
+    *t->pprev_ = t->next_;
+    if (t->next_)
+	t->next_->pprev_ = t->pprev_;
+    else
+	s->ptail_ = t->pprev_;
+    if (!s->head_ && s != &overflow_) {
+	int i = s - &slots_[0][0];
+	occupied_[i / wsize] &= ~((uint64_t) 1 << (i % wsize));
+    }
+}
+
+inline void driver_timerwheel::free_timer(wtimer *t) {
+    t->next_ = free_;
+    free_ = t;
+    --nt_;
+}
+
+inline void driver_timerwheel::cull() {
+    if (dead_)
+	reclaim();
+}
+
+inline void driver_timerwheel::push(const timeval &expiry, simple_event *se) {
+    if (!free_)
+	expand();
+    wtimer *t = free_;
+    free_ = t->next_;
+    // round up so a timer never fires early
+    t->tick_ = expiry.tv_sec * (uint64_t) 1000 + (expiry.tv_usec + 999) / 1000;
+    t->trigger_ = se;
+    ++nt_;
+    insert(t);
+    simple_event::at_trigger(se, new simple_event(cancelr_, (uintptr_t) t));
+}
+
+}}
+#endif /* TAMER_DINTERNAL_HH */
@@ -34,6 +34,9 @@ class driver_libevent : public driver { public:
     virtual bool empty();
     virtual void once();
     virtual void loop();
+    virtual const char *name() const {
+	return "libevent";
+    }
 
     struct eevent {
 	::event libevent;
@@ -56,8 +59,10 @@ class driver_libevent : public driver { public:
     eevent *_efree;
     size_t _ecap;
     eevent *_esignal;
+    rendezvous<eevent *> _fdcancelr;
 
     void expand_events();
+    void reap_canceled();
 
 };
 
@@ -68,12 +73,14 @@ void libevent_trigger(int, short, void *arg)
     driver_libevent::eevent *e = static_cast<driver_libevent::eevent *>(arg);
     if (*e->se && e->slot)
 	*e->slot = 0;
-    e->se->simple_trigger(true);
+    tamerpriv::simple_event *se = e->se;
     *e->pprev = e->next;
     if (e->next)
 	e->next->pprev = e->pprev;
+    e->se = 0;
     e->next = e->driver->_efree;
     e->driver->_efree = e;
+    se->simple_trigger(true);
 }
 
 void libevent_sigtrigger(int, short, void *arg)
@@ -142,6 +149,8 @@ void driver_libevent::store_fd(int fd, int action,
 			       tamerpriv::simple_event *se, int *slot)
 {
     assert(fd >= 0);
+    if (_fdcancelr.has_ready())
+	reap_canceled();
     if (!_efree)
 	expand_events();
     if (se) {
@@ -158,23 +167,46 @@ void driver_libevent::store_fd(int fd, int action,
 	if (_efd)
 	    _efd->pprev = &e->next;
 	_efd = e;
+	tamerpriv::simple_event::at_trigger(se, event<>(_fdcancelr, e).__take_simple());
     }
 }
 
+void driver_libevent::reap_canceled()
+{
+    // Drop canceled waits right away: libevent would otherwise keep fd
+    // registered, and miss a reuse of the number after a raw close().
+    // Notifications also arrive for events we triggered, or for eevents
+    // reused since; only an eevent still holding a dead event is culled.
+    eevent *e;
+    while (_fdcancelr.join(e))
+	if (e->se && !*e->se) {
+	    ::event_del(&e->libevent);
+	    tamerpriv::simple_event::unuse_clean(e->se);
+	    *e->pprev = e->next;
+	    if (e->next)
+		e->next->pprev = e->pprev;
+	    e->se = 0;
+	    e->next = _efree;
+	    _efree = e;
+	}
+}
+
 void driver_libevent::kill_fd(int fd)
 {
     eevent **ep = &_efd;
     for (eevent *e = *ep; e; e = *ep)
 	if (e->libevent.ev_fd == fd) {
 	    event_del(&e->libevent);
-	    if (*e->se && e->slot)
+	    tamerpriv::simple_event *se = e->se;
+	    if (*se && e->slot)
 		*e->slot = -ECANCELED;
-	    e->se->simple_trigger(true);
 	    *ep = e->next;
 	    if (*ep)
 		(*ep)->pprev = ep;
+	    e->se = 0;
 	    e->next = _efree;
 	    _efree = e;
+	    se->simple_trigger(true);
 	} else
 	    ep = &e->next;
 }
@@ -205,13 +237,16 @@ void driver_libevent::store_time(const timeval &expiry,
 
 bool driver_libevent::empty()
 {
+    if (_fdcancelr.has_ready())
+	reap_canceled();
     // remove dead events
     while (_etimer && !*_etimer->se) {
 	eevent *e = _etimer;
 	::event_del(&e->libevent);
-	tamerpriv::simple_event::unuse_clean(_etimer->se);
+	tamerpriv::simple_event::unuse_clean(e->se);
 	if ((_etimer = e->next))
 	    _etimer->pprev = &_etimer;
+	e->se = 0;
 	e->next = _efree;
 	_efree = e;
     }
@@ -219,9 +254,10 @@ bool driver_libevent::empty()
 	eevent *e = _efd;
 	if (e->libevent.ev_events)
 	    ::event_del(&e->libevent);
-	tamerpriv::simple_event::unuse_clean(_etimer->se);
+	tamerpriv::simple_event::unuse_clean(e->se);
 	if ((_efd = e->next))
 	    _efd->pprev = &_efd;
+	e->se = 0;
 	e->next = _efree;
 	_efree = e;
     }
@@ -234,6 +270,8 @@ bool driver_libevent::empty()
 
 void driver_libevent::once()
 {
+    if (_fdcancelr.has_ready())
+	reap_canceled();
     if (tamerpriv::abstract_rendezvous::has_unblocked())
 	::event_loop(EVLOOP_ONCE | EVLOOP_NONBLOCK);
     else
@@ -6,8 +6,10 @@
 #include <arpa/inet.h>
 #include <map>
 #include <list>
+#include <queue>
 #include <set>
 #include <sstream>
+#include <vector>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -15,6 +17,15 @@
 
 
 #define DNS_REPARSE_TIME 60
+/* seconds an idle TCP connection to a nameserver is kept open */
+#define DNS_TCP_IDLE_TIMEOUT 10
+
+/* default memory bound for the reply cache, in bytes */
+#define DNS_CACHE_SIZE (1 << 20)
+/* upper bound on how long any reply is cached, in seconds */
+#define DNS_CACHE_MAX_TTL 86400
+/* how long a server failure is cached (RFC 2308 allows up to 5 minutes) */
+#define DNS_SERVFAIL_TTL 30
 
 #define DNS_OPTION_SEARCH 1
 #define DNS_OPTION_NAMESERVERS 2
@@ -40,7 +51,21 @@
 
 #define CLASS_INET     1
 #define TYPE_A         1
+#define TYPE_CNAME     5
+#define TYPE_SOA       6
 #define TYPE_PTR       12
+#define TYPE_AAAA      28
+#define TYPE_SRV       33
+
+/* longest CNAME chain followed within one reply */
+#define DNS_MAX_CNAME_CHAIN 8
+/* most compression pointers followed while reading one name */
+#define DNS_MAX_NAME_POINTERS 32
+
+/* happy eyeballs: how long to wait for AAAA after A answers, and between
+ * connection attempts, in milliseconds (RFC 8305 recommends 50 and 250) */
+#define DNS_RESOLUTION_DELAY 50
+#define DNS_CONNECT_ATTEMPT_DELAY 250
 
 namespace tamer {
 namespace dns {
@@ -60,7 +85,20 @@ typedef ref_ptr<nameserver_imp> nameserver;
 }
 
 void gethostbyname(std::string name, bool search, event<dns::reply> result);
+void gethostbyname6(std::string name, bool search, event<dns::reply> result);
 void gethostbyaddr(struct in_addr *in, event<dns::reply> result);
+void getsrvbyname(std::string name, event<dns::reply> result);
+
+/* Connect to @a name:@a port, racing its IPv6 and IPv4 addresses
+ * (``happy eyeballs'', RFC 8305): both lookups start together; IPv6
+ * addresses are tried first, alternating with IPv4, and each further
+ * attempt starts after DNS_CONNECT_ATTEMPT_DELAY ms or when the previous
+ * one fails. The first connection to succeed wins.
+ */
+void tcp_connect(std::string name, int port, event<fd> result);
+/* The race itself, over addresses already looked up. */
+void tcp_connect(std::vector<struct in6_addr> addrs6,
+                 std::vector<uint32_t> addrs, int port, event<fd> result);
 
 namespace dns {
 
@@ -69,6 +107,8 @@ packet make_packet(uint8_t * buf, size_t size);
 reply make_reply(packet p);
 search_list make_search_list(int ndots);
 request make_request_a(std::string name, bool search = false, search_list s = search_list());
+request make_request_aaaa(std::string name, bool search = false, search_list s = search_list());
+request make_request_srv(std::string name, bool search = false, search_list s = search_list());
 request make_request_ptr(struct in_addr *in);
 nameserver make_nameserver(uint32_t addr, int port = 53);
 
@@ -260,23 +300,55 @@ private:
   void unspecified_method() const {};
 
 public:
+  struct srv_record {
+    uint16_t priority;
+    uint16_t weight;
+    uint16_t port;
+    std::string target;
+  };
+
   int err;
   uint16_t trans_id;
   uint32_t ttl;
-  std::vector<uint32_t> addrs;
-  std::string name;
+  std::vector<uint32_t> addrs;		// TYPE_A
+  std::vector<struct in6_addr> addrs6;	// TYPE_AAAA
+  std::vector<srv_record> srvs;		// TYPE_SRV
+  std::string name;			// TYPE_PTR
+  std::string cname;	// canonical name, if the question was an alias
 
   reply_imp(packet p);
+  reply_imp(const reply_imp &x, uint32_t ttl);
   operator unspecified_bool_type() const;
+  bool empty() const;
 
 private:
+  struct rrinfo {
+    std::string owner;
+    uint16_t type;
+    uint32_t ttl;
+    uint16_t rdlength;
+    off_t rdata;
+  };
+
   static int skip_name(ref_ptr<packet_imp> &p);
+  static int read_name(ref_ptr<packet_imp> &p, std::string &out);
+  static bool same_name(const std::string &a, const std::string &b);
 };
 
 inline reply make_reply(packet p) {
   return reply(new reply_imp(p));
 }
 
+inline reply_imp::reply_imp(const reply_imp &x, uint32_t ttl_)
+  : err(x.err), trans_id(x.trans_id), ttl(ttl_), addrs(x.addrs),
+    addrs6(x.addrs6), srvs(x.srvs), name(x.name), cname(x.cname) {
+}
+
+/* true iff the reply holds no answer to its question */
+inline bool reply_imp::empty() const {
+  return addrs.empty() && addrs6.empty() && srvs.empty() && name.empty();
+}
+
 inline reply_imp::operator unspecified_bool_type() const {
   return (err) ? 0 : &reply_imp::unspecified_method;
 }
@@ -326,10 +398,13 @@ public:
   int error() const;
   int tx_count() const;
   uint16_t trans_id() const;
+  uint16_t type() const;
+  const std::string &name() const;
 
   virtual bool hasnext() const = 0;
   virtual void next(uint16_t trans_id) = 0;
   void reissue(uint16_t trans_id);
+  void set_trans_id(uint16_t trans_id);
 
   int getpacket(packet &p, bool tcp = false);
 };
@@ -354,11 +429,26 @@ inline uint16_t request_imp::trans_id() const {
   return _trans_id;
 }
 
+inline uint16_t request_imp::type() const {
+  return _type;
+}
+
+inline const std::string &request_imp::name() const {
+  return _curr_name;
+}
+
 inline void request_imp::reissue(uint16_t trans_id) {
   _trans_id = trans_id;
   _tx_count++;
 }
 
+inline void request_imp::set_trans_id(uint16_t trans_id) {
+  _trans_id = trans_id;
+}
+
+/* A forward lookup of @a name, walking the search list if @a search.
+ * Asks for TYPE_A records unless another type is given.
+ */
 class request_a : public request_imp {
   int _search;
   std::string _name;
@@ -370,7 +460,8 @@ class request_a : public request_imp {
   static bool check_name(std::string name);
 
 public:
-  request_a(std::string name, bool search = false, search_list s = search_list());
+  request_a(std::string name, bool search = false, search_list s = search_list(),
+            uint16_t type = TYPE_A);
   ~request_a() {}
   bool hasnext() const;
   void next(uint16_t trans_id);
@@ -380,8 +471,17 @@ inline request make_request_a(std::string name, bool search, search_list s) {
   return request(new request_a(name, search, s));
 }
 
-inline request_a::request_a(std::string name, bool search, search_list s)
-  : request_imp(TYPE_A), _search(search), _name(name), _ndots(0), _s(s) {
+inline request make_request_aaaa(std::string name, bool search, search_list s) {
+  return request(new request_a(name, search, s, TYPE_AAAA));
+}
+
+inline request make_request_srv(std::string name, bool search, search_list s) {
+  return request(new request_a(name, search, s, TYPE_SRV));
+}
+
+inline request_a::request_a(std::string name, bool search, search_list s,
+                            uint16_t type)
+  : request_imp(type), _search(search), _name(name), _ndots(0), _s(s) {
 
   if ((_err = check_name(name) ? 0 : -1))
     return;
@@ -453,8 +553,8 @@ private:
   uint32_t _addr;
   int _port;
 
-  std::list<packet> _tcp_outgoing;
-  int _tcp_outbound;
+  std::list<packet> _tcp_outgoing;   // queries not yet written
+  int _tcp_outbound;                 // queries written, awaiting replies
 
   tamer::fd _udp;
   tamer::fd _tcp;
@@ -483,6 +583,8 @@ public:
   void query_tcp(packet p, timeval timeout);
 
 private:
+  void close_tcp();
+
   class closure__init__Qi_;
   void init(closure__init__Qi_ &);
 
@@ -523,6 +625,90 @@ inline bool nameserver_imp::operator< (const nameserver_imp &n) const {
 
 /////////////////////
 
+/* A question, (type, name), with the name in lower case since names
+ * compare case-insensitively. Keys the reply cache and in-flight queries.
+ */
+typedef std::pair<uint16_t, std::string> question;
+question make_question(const std::string &name, uint16_t type);
+
+struct cache_stats {
+  unsigned long long hits;
+  unsigned long long negative_hits;
+  unsigned long long misses;
+  unsigned long long evictions;
+  size_t entries;
+  size_t size;
+  cache_stats()
+    : hits(0), negative_hits(0), misses(0), evictions(0), entries(0), size(0) {
+  }
+};
+
+/* Replies keyed by question (name, type). Positive answers live for their
+ * smallest TTL; NXDOMAIN and empty answers for the negative TTL of RFC 2308;
+ * server failures, once every retransmission has failed, for
+ * DNS_SERVFAIL_TTL. The least recently used entries are evicted to keep the
+ * cache's approximate size under its bound.
+ */
+class reply_cache {
+public:
+  reply_cache(size_t max_size = DNS_CACHE_SIZE);
+
+  reply get(const std::string &name, uint16_t type);
+  void put(const std::string &name, uint16_t type, reply p);
+  void clear();
+
+  void set_max_size(size_t max_size);
+  const cache_stats &stats() const;
+
+private:
+  struct entry;
+  typedef std::map<question, entry> map_type;
+  struct entry {
+    reply r;
+    time_t expiry;
+    size_t size;
+    std::list<map_type::iterator>::iterator lru;
+  };
+
+  map_type _map;
+  std::list<map_type::iterator> _lru;	// most recently used first
+  size_t _max_size;
+  cache_stats _stats;
+
+  void remove(map_type::iterator it);
+  void shrink();
+};
+
+inline reply_cache::reply_cache(size_t max_size)
+  : _max_size(max_size) {
+}
+
+inline void reply_cache::set_max_size(size_t max_size) {
+  _max_size = max_size;
+  shrink();
+}
+
+inline const cache_stats &reply_cache::stats() const {
+  return _stats;
+}
+
+inline void reply_cache::clear() {
+  while (_map.size())
+    remove(_map.begin());
+}
+
+/* A question on the wire. Requests that ask the same question while it is
+ * outstanding wait on done instead of sending their own packet.
+ */
+struct pending_imp : public enable_ref_ptr {
+  reply result;
+  bool timeout;
+  event<> done;
+  pending_imp() : timeout(false) {}
+};
+
+typedef ref_ptr<pending_imp> pending;
+
 struct query {
   request q;
   event<reply> p;
@@ -531,6 +717,66 @@ struct query {
   operator uint16_t() { return q->trans_id(); }
 };
 
+/* Outstanding queries by transaction ID, with O(1) insert, lookup and
+ * removal and no per-query allocation. IDs are kept in a permutation with
+ * the ones in use at the front, so a uniformly random unused ID is a single
+ * draw away however full the table is. 0xFFFF is never used.
+ */
+class trans_table {
+public:
+  trans_table();
+  ~trans_table();
+
+  size_t size() const;
+  bool contains(uint16_t id) const;
+
+  uint16_t unused_id();                 // 0xFFFF if the table is full
+  void insert(const query &u);          // u's ID must be unused
+  bool remove(uint16_t id, query &u);
+  void erase(uint16_t id);
+  bool pop(query &u);                   // remove any query
+
+private:
+  enum { nids = 0xFFFF };
+
+  uint16_t *_ids;                       // IDs, the first _slots.size() in use
+  uint16_t *_pos;                       // _pos[id] is id's index in _ids
+  std::vector<query> _slots;            // _slots[i] is the query for _ids[i]
+
+  trans_table(const trans_table &);
+  trans_table &operator=(const trans_table &);
+
+  void initialize();
+  void swap_ids(size_t i, size_t j);
+  void remove_index(size_t i, query &u);
+  static uint32_t random32();
+};
+
+inline trans_table::trans_table()
+  : _ids(0), _pos(0) {
+}
+
+inline trans_table::~trans_table() {
+  delete[] _ids;
+  delete[] _pos;
+}
+
+inline size_t trans_table::size() const {
+  return _slots.size();
+}
+
+inline bool trans_table::contains(uint16_t id) const {
+  return _ids && id != nids && _pos[id] < _slots.size();
+}
+
+inline void trans_table::swap_ids(size_t i, size_t j) {
+  uint16_t t = _ids[i];
+  _ids[i] = _ids[j];
+  _ids[j] = t;
+  _pos[_ids[i]] = i;
+  _pos[_ids[j]] = j;
+}
+
 class resolver : public enable_ref_ptr_with_full_release<resolver> {
   typedef void (resolver::*unspecified_bool_type)() const;
   void unspecified_method() const {}
@@ -543,13 +789,17 @@ class resolver : public enable_ref_ptr_with_full_release<resolver> {
   int _max_retransmits;
   int _max_timeouts;
   int _max_reqs_inflight;
+  size_t _cache_size;
   search_list _search_list;
 
   int _err;
   int _reqs_inflight;
   struct stat _fst;
 
-  std::map<uint16_t, query> _requests;
+  trans_table _requests;
+  std::map<question, pending> _pending;
+  std::queue<event<> > _window;
+  reply_cache _cache;
 
   nameservers _nameservers;
   nameservers _failed;
@@ -617,8 +867,13 @@ class resolver : public enable_ref_ptr_with_full_release<resolver> {
 
     void ready(event<> e);
     void resolve_a(std::string name, bool search, event<reply> e);
+    void resolve_aaaa(std::string name, bool search, event<reply> e);
+    void resolve_srv(std::string name, bool search, event<reply> e);
     void resolve_ptr(struct in_addr *in, event<reply> e);
 
+    const cache_stats &cache_statistics() const;
+    void flush_cache();
+
     void full_release();
 };
 
@@ -640,6 +895,14 @@ inline int resolver::error() const {
   return _err;
 }
 
+inline const cache_stats &resolver::cache_statistics() const {
+  return _cache.stats();
+}
+
+inline void resolver::flush_cache() {
+  _cache.clear();
+}
+
 inline void resolver::resolve_a(std::string name, bool search, event<reply> e) {
   request q;
 
@@ -650,6 +913,26 @@ inline void resolver::resolve_a(std::string name, bool search, event<reply> e) {
     resolve(q, e);
 }
 
+inline void resolver::resolve_aaaa(std::string name, bool search, event<reply> e) {
+  request q;
+
+  q = make_request_aaaa(name, search, _search_list);
+  if (!*q)
+    e.trigger(reply());
+  else
+    resolve(q, e);
+}
+
+inline void resolver::resolve_srv(std::string name, bool search, event<reply> e) {
+  request q;
+
+  q = make_request_srv(name, search, _search_list);
+  if (!*q)
+    e.trigger(reply());
+  else
+    resolve(q, e);
+}
+
 inline void resolver::resolve_ptr(struct in_addr *in, event<reply> e) {
   request q;
 
@@ -660,10 +943,9 @@ inline void resolver::resolve_ptr(struct in_addr *in, event<reply> e) {
 inline void resolver::full_release() {
   _nameservers.clear();
   _failed.clear();
-  for (std::map<uint16_t, query >::iterator i = _requests.begin();
-      i != _requests.end(); i++)
-    i->second.p.trigger(reply());
-  _requests.clear();
+  query u;
+  while (_requests.pop(u))
+    u.p.trigger(reply());
 }
 
 inline nameserver resolver::next_nameserver() {
@@ -684,6 +966,7 @@ inline void resolver::set_default_options() {
   _max_retransmits = 1;
   _max_timeouts = 3;
   _max_reqs_inflight = 64;
+  _cache_size = DNS_CACHE_SIZE;
 }
 
 inline void resolver::set_from_hostname() {
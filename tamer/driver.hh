@@ -21,12 +21,29 @@ namespace tamer {
  *  loop.
  */
 
+/** @brief  Flags for initialize(). */
+enum init_flags {
+    use_tamer = 1,		///< Use the select()-based driver.
+    use_libevent = 2,		///< Use the libevent driver, if available.
+    use_epoll = 4,		///< Use the epoll() driver, if available.
+    use_io_uring = 8,		///< Use the io_uring driver, if available.
+    use_timer_wheel = 16	///< Keep timers in a timing wheel, not a heap.
+};
+
 /** @brief  Initialize the Tamer event loop.
+ *  @param  flags  Driver selection flags (see tamer::init_flags).
  *
  *  Must be called at least once before any primitive Tamer events are
  *  registered.
+ *
+ *  By default, Tamer uses libevent if it is available, then epoll(), then
+ *  select(). Setting the TAMER_NOLIBEVENT or TAMER_NOEPOLL environment
+ *  variables skips the corresponding driver. A driver requested in @a flags
+ *  is used if available, regardless of the environment. The io_uring driver
+ *  is used only when requested; if it is unavailable, Tamer falls back to
+ *  epoll(), then select().
  */
-void initialize();
+void initialize(int flags = 0);
 
 /** @brief  Clean up the Tamer event loop.
  *
@@ -35,6 +52,29 @@ void initialize();
  */
 void cleanup();
 
+/** @brief  Run an event loop on each of several threads.
+ *  @param  nloops  Number of loops, or 0 for one per online processor.
+ *  @param  start   Function called on each loop's thread with the loop's
+ *                  index (0 to @a nloops - 1) and @a arg.
+ *  @param  arg     Argument for @a start.
+ *  @param  flags   Driver selection flags (see tamer::init_flags).
+ *  @return  A negative error code if threads could not be started;
+ *  otherwise does not return.
+ *
+ *  Each thread initializes its own driver, calls @a start to register its
+ *  initial events, and runs loop(). Loop 0 runs on the calling thread,
+ *  using its driver if it already has one. New drivers never use libevent,
+ *  and prefer epoll() when no driver is requested.
+ *
+ *  Events, rendezvous, and file descriptors belong to the loop that
+ *  created them and must not be used from other threads. Signals are
+ *  delivered on the first loop that calls at_signal(). A typical server
+ *  calls fdx::tcp_listen_shared() in @a start, so the kernel spreads
+ *  incoming connections across loops.
+ */
+int loop_threads(int nloops, void (*start)(int, void *), void *arg,
+		 int flags = 0);
+
 /** @brief  Fetches Tamer's current time.
  *  @return  Current timestamp.
  */
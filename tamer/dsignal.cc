@@ -22,6 +22,7 @@ namespace tamer {
 
 volatile sig_atomic_t driver::sig_any_active;
 int driver::sig_pipe[2] = { -1, -1 };
+driver *driver::sig_driver;
 
 extern "C" { typedef void (*tamer_sighandler)(int); }
 static int tamer_sigaction(int signo, tamer_sighandler handler)
@@ -89,6 +90,9 @@ void driver::at_signal(int signo, const event<> &trigger)
 	fcntl(sig_pipe[1], F_SETFD, FD_CLOEXEC);
     }
 
+    if (!sig_driver)
+	sig_driver = main;
+
     if (!trigger)		// special case forces creation of signal pipe
 	return;
 
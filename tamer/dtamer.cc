@@ -13,6 +13,7 @@
  */
 #include "config.h"
 #include <tamer/tamer.hh>
+#include "dinternal.hh"
 #include <sys/select.h>
 #include <stdio.h>
 #include <unistd.h>
@@ -24,7 +25,7 @@ namespace {
 
 class driver_tamer : public driver { public:
 
-    driver_tamer();
+    driver_tamer(int flags);
     ~driver_tamer();
 
     virtual void store_fd(int fd, int action, tamerpriv::simple_event *se,
@@ -36,26 +37,12 @@ class driver_tamer : public driver { public:
     virtual bool empty();
     virtual void once();
     virtual void loop();
+    virtual const char *name() const {
+	return "select";
+    }
 
   private:
 
-    struct ttimer {
-	timeval expiry_;
-	unsigned order_;
-	tamerpriv::simple_event *trigger_;
-	ttimer(const timeval &expiry, unsigned order,
-	       tamerpriv::simple_event *trigger)
-	    : expiry_(expiry), order_(order), trigger_(trigger) {
-	}
-	bool operator>(const ttimer &x) const {
-	    if (expiry_.tv_sec != x.expiry_.tv_sec)
-		return expiry_.tv_sec > x.expiry_.tv_sec;
-	    if (expiry_.tv_usec != x.expiry_.tv_usec)
-		return expiry_.tv_usec > x.expiry_.tv_usec;
-	    return (int) (order_ - x.order_) > 0;
-	}
-    };
-
     struct tfd {
 	int fd : 30;
 	unsigned action : 2;
@@ -74,44 +61,29 @@ class driver_tamer : public driver { public:
 	char s[1];
     };
 
-    ttimer *t_;
-    int nt_;
-    int tcap_;
-    unsigned torder_;
+    tamerpriv::driver_timerset timers_;
+    tamerpriv::driver_asapset asap_;
 
     tfd *_fd;
     int _nfds;
     xfd_set *_fdset[4];
     int _fdset_cap;
 
-    tamerpriv::simple_event **asap_;
-    unsigned asap_head_;
-    unsigned asap_tail_;
-    unsigned asap_capmask_;
-
     int _fdcap;
     tfd_group *_fdgroup;
     tfd *_fdfree;
     rendezvous<> _fdcancelr;
 
-    void expand_timers();
-    void check_timers() const;
-    void timer_reheapify_from(int pos);
     void expand_fds();
-    void cull_timers();
-    void expand_asap();
 
 };
 
 
-driver_tamer::driver_tamer()
-    : t_(0), nt_(0), tcap_(0), torder_(0),
-      _fd(0), _nfds(0), _fdset_cap(sizeof(xfd_set) * 8),
-      asap_(0), asap_head_(0), asap_tail_(0), asap_capmask_(-1U),
+driver_tamer::driver_tamer(int flags)
+    : timers_(flags & use_timer_wheel), _fd(0), _nfds(0), _fdset_cap(sizeof(xfd_set) * 8),
       _fdcap(0), _fdgroup(0), _fdfree(0)
 {
     assert(FD_SETSIZE <= _fdset_cap);
-    expand_timers();
     for (int i = 0; i < 4; ++i)
 	_fdset[i] = reinterpret_cast<xfd_set *>(new char[_fdset_cap / 8]);
     FD_ZERO(&_fdset[fdread]->fds);
@@ -121,18 +93,6 @@ driver_tamer::driver_tamer()
 
 driver_tamer::~driver_tamer()
 {
-    // destroy all active timers
-    for (int i = 0; i < nt_; i++)
-	tamerpriv::simple_event::unuse(t_[i].trigger_);
-    delete[] reinterpret_cast<char *>(t_);
-
-    // destroy all active asaps
-    while (asap_head_ != asap_tail_) {
-	tamerpriv::simple_event::unuse(asap_[asap_head_ & asap_capmask_]);
-	++asap_head_;
-    }
-    delete[] asap_;
-
     // destroy all active file descriptors
     while (_fd) {
 	tamerpriv::simple_event::unuse(_fd->se);
@@ -151,82 +111,6 @@ driver_tamer::~driver_tamer()
 	delete[] reinterpret_cast<char *>(_fdset[i]);
 }
 
-void driver_tamer::expand_timers()
-{
-    int ntcap = (tcap_ ? ((tcap_ + 1) * 2 - 1) : 511);
-    ttimer *nt = reinterpret_cast<ttimer *>(new char[sizeof(ttimer) * ntcap]);
-    if (nt_ != 0)
-	// take advantage of fact that memcpy() works on event<>
-	memcpy(nt, t_, sizeof(ttimer) * nt_);
-    delete[] reinterpret_cast<char *>(t_);
-    t_ = nt;
-    tcap_ = ntcap;
-}
-
-void driver_tamer::expand_asap()
-{
-    unsigned ncapmask =
-	(asap_capmask_ + 1 ? ((asap_capmask_ + 1) * 4 - 1) : 31);
-    tamerpriv::simple_event **na = new tamerpriv::simple_event *[ncapmask + 1];
-    unsigned i = 0;
-    for (unsigned x = asap_head_; x != asap_tail_; ++x, ++i)
-	na[i] = asap_[x & asap_capmask_];
-    delete[] asap_;
-    asap_ = na;
-    asap_capmask_ = ncapmask;
-    asap_head_ = 0;
-    asap_tail_ = i;
-}
-
-void driver_tamer::timer_reheapify_from(int pos)
-{
-    int npos;
-    while (pos > 0
-	   && (npos = (pos - 1) >> 1, t_[npos] > t_[pos])) {
-	std::swap(t_[pos], t_[npos]);
-	pos = npos;
-    }
-
-    while (1) {
-	int smallest = pos;
-	npos = 2*pos + 1;
-	if (npos < nt_ && t_[smallest] > t_[npos])
-	    smallest = npos;
-	if (npos + 1 < nt_ && t_[smallest] > t_[npos + 1])
-	    smallest = npos + 1, ++npos;
-	if (smallest == pos)
-	    break;
-	std::swap(t_[pos], t_[smallest]);
-	pos = smallest;
-    }
-#if 0
-    if (_t + 1 < tend || !will_delete)
-	_timer_expiry = tbegin[0]->expiry;
-    else
-	_timer_expiry = Timestamp();
-#endif
-}
-
-#if 0
-void driver_tamer::check_timers() const
-{
-    fprintf(stderr, "---");
-    for (int k = 0; k < _nt; k++)
-	fprintf(stderr, " %p/%d.%06d", _t[k], _t[k]->expiry.tv_sec, _t[k]->expiry.tv_usec);
-    fprintf(stderr, "\n");
-
-    for (int i = 0; i < _nt / 2; i++)
-	for (int j = 2*i + 1; j < 2*i + 3; j++)
-	    if (j < _nt && *_t[i] > *_t[j]) {
-		fprintf(stderr, "***");
-		for (int k = 0; k < _nt; k++)
-		    fprintf(stderr, (k == i || k == j ? " **%d.%06d**" : " %d.%06d"), _t[k]->expiry.tv_sec, _t[k]->expiry.tv_usec);
-		fprintf(stderr, "\n");
-		assert(0);
-	    }
-}
-#endif
-
 void driver_tamer::expand_fds()
 {
     int ncap = (_fdcap ? _fdcap * 2 : 16);
@@ -301,43 +185,22 @@ void driver_tamer::kill_fd(int fd)
 void driver_tamer::store_time(const timeval &expiry,
 			      tamerpriv::simple_event *se)
 {
-    if (se) {
-	if (nt_ == tcap_)
-	    expand_timers();
-	(void) new(static_cast<void *>(&t_[nt_])) ttimer(expiry, ++torder_, se);
-	++nt_;
-	timer_reheapify_from(nt_ - 1);
-    }
+    if (se)
+	timers_.push(expiry, se);
 }
 
 void driver_tamer::store_asap(tamerpriv::simple_event *se)
 {
-    if (se) {
-	if (asap_tail_ - asap_head_ == asap_capmask_ + 1)
-	    expand_asap();
-	asap_[asap_tail_ & asap_capmask_] = se;
-	++asap_tail_;
-    }
-}
-
-void driver_tamer::cull_timers()
-{
-    while (nt_ != 0 && t_[0].trigger_->empty()) {
-	tamerpriv::simple_event::unuse(t_[0].trigger_);
-	--nt_;
-	if (nt_ != 0) {
-	    t_[0] = t_[nt_];
-	    timer_reheapify_from(0);
-	}
-    }
+    if (se)
+	asap_.push(se);
 }
 
 bool driver_tamer::empty()
 {
-    cull_timers();
-    if (asap_head_ != asap_tail_
-	|| nt_ != 0
-	|| sig_any_active
+    timers_.cull();
+    if (!asap_.empty()
+	|| !timers_.empty()
+	|| sig_pending()
 	|| tamerpriv::abstract_rendezvous::has_unblocked()
 	|| _nfds != 0)
 	return false;
@@ -347,18 +210,18 @@ bool driver_tamer::empty()
 void driver_tamer::once()
 {
     // determine timeout
-    cull_timers();
+    timers_.cull();
     struct timeval to, *toptr;
-    if (asap_head_ != asap_tail_
-	|| (nt_ != 0 && !timercmp(&t_[0].expiry_, &now, >))
-	|| sig_any_active
+    if (!asap_.empty()
+	|| (!timers_.empty() && !timercmp(&timers_.expiry(), &now, >))
+	|| sig_pending()
 	|| tamerpriv::abstract_rendezvous::has_unblocked()) {
 	timerclear(&to);
 	toptr = &to;
-    } else if (nt_ == 0)
+    } else if (timers_.empty())
 	toptr = 0;
     else {
-	timersub(&t_[0].expiry_, &now, &to);
+	timersub(&timers_.expiry(), &now, &to);
 	toptr = &to;
     }
 
@@ -385,29 +248,25 @@ void driver_tamer::once()
     }
 
     // select!
-    int nfds = _nfds;
-    if (nfds > 0 || sig_pipe[0] >= 0) {
+    int nfds = _nfds, sigfd = sig_fd();
+    if (nfds > 0 || sigfd >= 0) {
 	memcpy(_fdset[fdread + 2], _fdset[fdread], ((nfds + 63) & ~63) >> 3);
 	memcpy(_fdset[fdwrite + 2], _fdset[fdwrite], ((nfds + 63) & ~63) >> 3);
-	if (sig_pipe[0] >= 0) {
-	    FD_SET(sig_pipe[0], &_fdset[fdread + 2]->fds);
-	    if (sig_pipe[0] > nfds)
-		nfds = sig_pipe[0] + 1;
+	if (sigfd >= 0) {
+	    FD_SET(sigfd, &_fdset[fdread + 2]->fds);
+	    if (sigfd > nfds)
+		nfds = sigfd + 1;
 	}
 	nfds = select(nfds, &_fdset[fdread + 2]->fds,
 		      &_fdset[fdwrite + 2]->fds, 0, toptr);
     }
 
     // run signals
-    if (sig_any_active)
+    if (sig_pending())
 	dispatch_signals();
 
     // run asaps
-    while (asap_head_ != asap_tail_) {
-	tamerpriv::simple_event *se = asap_[asap_head_ & asap_capmask_];
-	++asap_head_;
-	se->simple_trigger(false);
-    }
+    asap_.run();
 
     // run file descriptors
     if (nfds > 0) {
@@ -434,17 +293,9 @@ void driver_tamer::once()
     }
 
     // run the timers that worked
-    if (nt_ != 0) {
+    if (!timers_.empty()) {
 	set_now();
-	while (nt_ != 0 && !timercmp(&t_[0].expiry_, &now, >)) {
-	    tamerpriv::simple_event *trigger = t_[0].trigger_;
-	    --nt_;
-	    if (nt_ != 0) {
-		t_[0] = t_[nt_];
-		timer_reheapify_from(0);
-	    }
-	    trigger->simple_trigger(false);
-	}
+	timers_.run(now);
     }
 
     // run active closures
@@ -473,9 +324,9 @@ void driver_tamer::loop()
 
 }
 
-driver *driver::make_tamer()
+driver *driver::make_tamer(int flags)
 {
-    return new driver_tamer;
+    return new driver_tamer(flags);
 }
 
 }
@@ -0,0 +1,556 @@
+/* Copyright (c) 2007-2012, Eddie Kohler
+ * Copyright (c) 2007, Regents of the University of California
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include "config.h"
+#include <tamer/tamer.hh>
+#include "dinternal.hh"
+#if HAVE_LINUX_IO_URING_H
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <endian.h>
+#endif
+#if HAVE_LINUX_IO_URING_H && defined(__NR_io_uring_setup) && defined(IORING_ENTER_EXT_ARG)
+# define TAMER_IO_URING 1
+#endif
+
+namespace tamer {
+#if TAMER_IO_URING
+namespace {
+
+// This driver submits one-shot IORING_OP_POLL_ADD requests. Requests made
+// by store_fd() are queued in the submission ring and handed to the kernel
+// together, in the same io_uring_enter() call that waits for completions;
+// completions are read straight from the shared ring.
+
+class driver_io_uring : public driver { public:
+
+    driver_io_uring(int flags);
+    ~driver_io_uring();
+
+    bool setup();
+
+    virtual void store_fd(int fd, int action, tamerpriv::simple_event *se,
+			  int *slot);
+    virtual void store_time(const timeval &expiry, tamerpriv::simple_event *se);
+    virtual void store_asap(tamerpriv::simple_event *se);
+    virtual void kill_fd(int fd);
+
+    virtual bool empty();
+    virtual void once();
+    virtual void loop();
+    virtual const char *name() const {
+	return "io_uring";
+    }
+
+  private:
+
+    struct tfd {
+	tamerpriv::simple_event *se;
+	int *slot;
+	tfd *next;
+    };
+
+    struct tfd_group {
+	tfd_group *next;
+	tfd t[1];
+    };
+
+    struct ufd {
+	tfd *w[2];		// waiters, indexed by fdread/fdwrite
+	unsigned gen[2];	// distinguishes polls that were removed
+	unsigned armed;		// bit per action: poll request outstanding
+    };
+
+    enum { nentries = 1024 };
+    static const uint64_t sig_data = ~(uint64_t) 0;
+    static const uint64_t ignore_data = ~(uint64_t) 1;
+
+    int ringfd_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned *sq_head_;
+    unsigned *sq_tail_;
+    unsigned *sq_array_;
+    io_uring_sqe *sqes_;
+    unsigned sq_local_tail_;
+    unsigned nsubmit_;
+    unsigned cq_mask_;
+    unsigned *cq_head_;
+    unsigned *cq_tail_;
+    io_uring_cqe *cqes_;
+    void *sq_map_;
+    size_t sq_map_size_;
+    void *cq_map_;
+    size_t cq_map_size_;
+
+    ufd *fds_;
+    int fdcap_;
+    int nwaiting_;
+    bool sig_armed_;
+
+    tamerpriv::driver_timerset timers_;
+    tamerpriv::driver_asapset asap_;
+
+    int _fdcap;
+    tfd_group *_fdgroup;
+    tfd *_fdfree;
+    rendezvous<int> _fdcancelr;
+
+    void expand_fds();
+    void expand_fdstate(int fd);
+    io_uring_sqe *get_sqe();
+    void submit(unsigned min_complete, const timeval *timeout);
+    void queue_poll(int fd, int action);
+    void remove_poll(int fd, int action);
+    void cull_fd(int fd);
+    void reap_canceled();
+    void trigger_list(tfd *t, int result);
+    void reap_completions();
+
+};
+
+
+static inline int sys_io_uring_setup(unsigned entries, io_uring_params *p) {
+    return (int) syscall(__NR_io_uring_setup, entries, p);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit,
+				     unsigned min_complete, unsigned flags,
+				     const void *arg, size_t argsz) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			 flags, arg, argsz);
+}
+
+
+driver_io_uring::driver_io_uring(int flags)
+    : ringfd_(-1), sqes_(0), sq_local_tail_(0), nsubmit_(0),
+      sq_map_(MAP_FAILED), sq_map_size_(0), cq_map_(MAP_FAILED),
+      cq_map_size_(0),
+      fds_(0), fdcap_(0), nwaiting_(0), sig_armed_(false),
+      timers_(flags & use_timer_wheel), _fdcap(0), _fdgroup(0), _fdfree(0)
+{
+    set_now();
+}
+
+bool driver_io_uring::setup()
+{
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    if ((ringfd_ = sys_io_uring_setup(nentries, &p)) < 0)
+	return false;
+    // require timeouts on io_uring_enter() and no dropped completions
+    if (!(p.features & IORING_FEAT_EXT_ARG)
+	|| !(p.features & IORING_FEAT_NODROP))
+	return false;
+
+    sq_map_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+	if (cq_map_size_ > sq_map_size_)
+	    sq_map_size_ = cq_map_size_;
+	cq_map_size_ = 0;
+    }
+    sq_map_ = mmap(0, sq_map_size_, PROT_READ | PROT_WRITE,
+		   MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_SQ_RING);
+    if (sq_map_ == MAP_FAILED)
+	return false;
+    void *cq = sq_map_;
+    if (cq_map_size_) {
+	cq_map_ = mmap(0, cq_map_size_, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, ringfd_, IORING_OFF_CQ_RING);
+	if (cq_map_ == MAP_FAILED)
+	    return false;
+	cq = cq_map_;
+    }
+    void *sqes = mmap(0, p.sq_entries * sizeof(io_uring_sqe),
+		      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+		      ringfd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+	return false;
+    sqes_ = static_cast<io_uring_sqe *>(sqes);
+
+    char *sqp = static_cast<char *>(sq_map_), *cqp = static_cast<char *>(cq);
+    sq_head_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned *>(sqp + p.sq_off.ring_mask);
+    sq_entries_ = p.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned *>(sqp + p.sq_off.array);
+    sq_local_tail_ = *sq_tail_;
+    cq_head_ = reinterpret_cast<unsigned *>(cqp + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned *>(cqp + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned *>(cqp + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe *>(cqp + p.cq_off.cqes);
+    return true;
+}
+
+driver_io_uring::~driver_io_uring()
+{
+    // destroy all active file descriptors
+    for (int fd = 0; fd < fdcap_; ++fd)
+	for (int action = 0; action < 2; ++action)
+	    for (tfd *t = fds_[fd].w[action]; t; t = t->next)
+		tamerpriv::simple_event::unuse(t->se);
+    delete[] fds_;
+
+    // free file descriptor groups
+    while (_fdgroup) {
+	tfd_group *next = _fdgroup->next;
+	delete[] reinterpret_cast<unsigned char *>(_fdgroup);
+	_fdgroup = next;
+    }
+
+    if (sqes_)
+	munmap(sqes_, sq_entries_ * sizeof(io_uring_sqe));
+    if (cq_map_ != MAP_FAILED)
+	munmap(cq_map_, cq_map_size_);
+    if (sq_map_ != MAP_FAILED)
+	munmap(sq_map_, sq_map_size_);
+    if (ringfd_ >= 0)
+	::close(ringfd_);
+}
+
+void driver_io_uring::expand_fds()
+{
+    int ncap = (_fdcap ? _fdcap * 2 : 16);
+
+    tfd_group *ngroup = reinterpret_cast<tfd_group *>(new unsigned char[sizeof(tfd_group) + sizeof(tfd) * (ncap - 1)]);
+    ngroup->next = _fdgroup;
+    _fdgroup = ngroup;
+    for (int i = 0; i < ncap; i++) {
+	ngroup->t[i].next = _fdfree;
+	_fdfree = &ngroup->t[i];
+    }
+    _fdcap += ncap;
+}
+
+void driver_io_uring::expand_fdstate(int fd)
+{
+    int ncap = (fdcap_ ? fdcap_ * 2 : 256);
+    while (ncap <= fd)
+	ncap *= 2;
+    ufd *nfds = new ufd[ncap];
+    if (fdcap_)
+	memcpy(nfds, fds_, sizeof(ufd) * fdcap_);
+    memset(nfds + fdcap_, 0, sizeof(ufd) * (ncap - fdcap_));
+    delete[] fds_;
+    fds_ = nfds;
+    fdcap_ = ncap;
+}
+
+io_uring_sqe *driver_io_uring::get_sqe()
+{
+    // The kernel consumes submissions only inside io_uring_enter(), so a
+    // full ring means our own batch is full: hand it over and continue.
+    if (sq_local_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)
+	== sq_entries_)
+	submit(0, 0);
+    unsigned idx = sq_local_tail_ & sq_mask_;
+    io_uring_sqe *sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++sq_local_tail_;
+    ++nsubmit_;
+    return sqe;
+}
+
+void driver_io_uring::submit(unsigned min_complete, const timeval *timeout)
+{
+    __atomic_store_n(sq_tail_, sq_local_tail_, __ATOMIC_RELEASE);
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    __kernel_timespec ts;
+    if (min_complete) {
+	flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+	memset(&arg, 0, sizeof(arg));
+	if (timeout) {
+	    ts.tv_sec = timeout->tv_sec;
+	    ts.tv_nsec = timeout->tv_usec * 1000;
+	    arg.ts = reinterpret_cast<uintptr_t>(&ts);
+	}
+    }
+    int r = sys_io_uring_enter(ringfd_, nsubmit_, min_complete, flags,
+			       flags ? &arg : 0, flags ? sizeof(arg) : 0);
+    if (r > 0)
+	nsubmit_ -= (unsigned) r > nsubmit_ ? nsubmit_ : r;
+}
+
+void driver_io_uring::queue_poll(int fd, int action)
+{
+    io_uring_sqe *sqe = get_sqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    uint32_t events = (action == fdread ? POLLIN : POLLOUT);
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = (events << 16) | (events >> 16);
+#endif
+    sqe->poll32_events = events;
+    sqe->user_data = ((uint64_t) fds_[fd].gen[action] << 32)
+	| ((uint64_t) fd << 1) | action;
+    fds_[fd].armed |= 1U << action;
+}
+
+void driver_io_uring::remove_poll(int fd, int action)
+{
+    // An outstanding poll keeps the file alive; remove it, and bump the
+    // generation so a completion that races the removal is ignored.
+    ufd &uf = fds_[fd];
+    if (uf.armed & (1U << action)) {
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = ((uint64_t) uf.gen[action] << 32)
+	    | ((uint64_t) fd << 1) | action;
+	sqe->user_data = ignore_data;
+	uf.armed &= ~(1U << action);
+    }
+    ++uf.gen[action];
+}
+
+void driver_io_uring::store_fd(int fd, int action, tamerpriv::simple_event *se,
+			       int *slot)
+{
+    assert(fd >= 0 && (action == fdread || action == fdwrite));
+    // A canceled wait on a descriptor closed behind our back must go
+    // before we trust fd's registration state.
+    if (_fdcancelr.has_ready())
+	reap_canceled();
+    if (se && *se) {
+	if (!_fdfree)
+	    expand_fds();
+	if (fd >= fdcap_)
+	    expand_fdstate(fd);
+
+	tfd *t = _fdfree;
+	_fdfree = t->next;
+	t->se = se;
+	t->slot = slot;
+	t->next = fds_[fd].w[action];
+	fds_[fd].w[action] = t;
+	++nwaiting_;
+
+	if (!(fds_[fd].armed & (1U << action)))
+	    queue_poll(fd, action);
+	tamerpriv::simple_event::at_trigger(se, event<>(_fdcancelr, fd).__take_simple());
+    } else
+	tamerpriv::simple_event::unuse_clean(se);
+}
+
+void driver_io_uring::trigger_list(tfd *t, int result)
+{
+    // The list has already been detached from fds_, so triggered events may
+    // safely register new waiters (even if that reallocates fds_).
+    while (t) {
+	if (*t->se && t->slot)
+	    *t->slot = result;
+	t->se->simple_trigger(true);
+	--nwaiting_;
+	tfd *next = t->next;
+	t->next = _fdfree;
+	_fdfree = t;
+	t = next;
+    }
+}
+
+void driver_io_uring::kill_fd(int fd)
+{
+    assert(fd >= 0);
+    if (fd >= fdcap_)
+	return;
+    ufd &uf = fds_[fd];
+    tfd *r = uf.w[fdread], *w = uf.w[fdwrite];
+    uf.w[fdread] = uf.w[fdwrite] = 0;
+    remove_poll(fd, fdread);
+    remove_poll(fd, fdwrite);
+    trigger_list(r, -ECANCELED);
+    trigger_list(w, -ECANCELED);
+}
+
+void driver_io_uring::cull_fd(int fd)
+{
+    ufd &uf = fds_[fd];
+    for (int action = 0; action < 2; ++action) {
+	tfd **pprev = &uf.w[action], *t;
+	while ((t = *pprev))
+	    if (!*t->se) {
+		tamerpriv::simple_event::unuse_clean(t->se);
+		--nwaiting_;
+		*pprev = t->next;
+		t->next = _fdfree;
+		_fdfree = t;
+	    } else
+		pprev = &t->next;
+	// nobody is left to wait: don't let the poll outlive them
+	if (!uf.w[action] && (uf.armed & (1U << action)))
+	    remove_poll(fd, action);
+    }
+}
+
+void driver_io_uring::reap_canceled()
+{
+    int fd;
+    while (_fdcancelr.join(fd))
+	if (fd < fdcap_)
+	    cull_fd(fd);
+}
+
+void driver_io_uring::store_time(const timeval &expiry,
+				 tamerpriv::simple_event *se)
+{
+    if (se)
+	timers_.push(expiry, se);
+}
+
+void driver_io_uring::store_asap(tamerpriv::simple_event *se)
+{
+    if (se)
+	asap_.push(se);
+}
+
+bool driver_io_uring::empty()
+{
+    timers_.cull();
+    if (_fdcancelr.has_ready())
+	reap_canceled();
+    if (!asap_.empty()
+	|| !timers_.empty()
+	|| sig_pending()
+	|| tamerpriv::abstract_rendezvous::has_unblocked()
+	|| nwaiting_ != 0)
+	return false;
+    return true;
+}
+
+void driver_io_uring::reap_completions()
+{
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    while (head != tail) {
+	for (; head != tail; ++head) {
+	    io_uring_cqe *cqe = &cqes_[head & cq_mask_];
+	    uint64_t data = cqe->user_data;
+	    int res = cqe->res;
+	    if (data == sig_data) {
+		sig_armed_ = false;
+		continue;
+	    } else if (data == ignore_data)
+		continue;
+	    int fd = (data & 0xFFFFFFFFU) >> 1, action = data & 1;
+	    if (fd >= fdcap_ || fds_[fd].gen[action] != (unsigned) (data >> 32))
+		continue;
+	    fds_[fd].armed &= ~(1U << action);
+	    tfd *t = fds_[fd].w[action];
+	    fds_[fd].w[action] = 0;
+	    // a failed poll (-EBADF, say) is passed on, as kill_fd() does
+	    trigger_list(t, res < 0 ? res : 0);
+	}
+	__atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+	tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    }
+}
+
+void driver_io_uring::once()
+{
+    // get rid of canceled descriptors, if any
+    if (_fdcancelr.has_ready())
+	reap_canceled();
+
+    // determine timeout
+    timers_.cull();
+    timeval to, *toptr;
+    if (!asap_.empty()
+	|| (!timers_.empty() && !timercmp(&timers_.expiry(), &now, >))
+	|| sig_pending()
+	|| tamerpriv::abstract_rendezvous::has_unblocked()) {
+	timerclear(&to);
+	toptr = &to;
+    } else if (timers_.empty())
+	toptr = 0;
+    else {
+	timersub(&timers_.expiry(), &now, &to);
+	toptr = &to;
+    }
+
+    // make sure signals wake us up
+    if (sig_fd() >= 0 && !sig_armed_) {
+	io_uring_sqe *sqe = get_sqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = sig_pipe[0];
+	uint32_t events = POLLIN;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	events = (events << 16) | (events >> 16);
+#endif
+	sqe->poll32_events = events;
+	sqe->user_data = sig_data;
+	sig_armed_ = true;
+    }
+
+    // submit this round's polls and wait, all in one system call
+    if (toptr && !timerisset(toptr)) {
+	if (nsubmit_)
+	    submit(0, 0);
+    } else if (nwaiting_ != 0 || sig_armed_ || toptr)
+	submit(1, toptr);
+
+    // run signals
+    if (sig_pending())
+	dispatch_signals();
+
+    // run asaps
+    asap_.run();
+
+    // run file descriptors
+    reap_completions();
+
+    // run the timers that worked
+    if (!timers_.empty()) {
+	set_now();
+	timers_.run(now);
+    }
+
+    // run active closures
+    while (tamerpriv::abstract_rendezvous *r = tamerpriv::abstract_rendezvous::pop_unblocked())
+	r->run();
+}
+
+void driver_io_uring::loop()
+{
+    while (1)
+	once();
+}
+
+}
+
+driver *driver::make_io_uring(int flags)
+{
+    driver_io_uring *d = new driver_io_uring(flags);
+    if (!d->setup()) {
+	delete d;
+	return 0;
+    }
+    return d;
+}
+
+#else
+
+driver *driver::make_io_uring(int)
+{
+    return 0;
+}
+
+#endif
+}
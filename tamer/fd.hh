@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <vector>
 namespace tamer {
@@ -342,6 +343,30 @@ class fd {
     inline void read_once(void *buf, size_t size, size_t &nread,
 			  event<int> done);
 
+    /** @brief  Read from file descriptor into several buffers.
+     *  @param       iov     Buffer array.
+     *  @param       iovcnt  Number of buffers.
+     *  @param[out]  nread   Number of characters read.
+     *  @param       done    Event triggered on completion.
+     *
+     *  Fills the buffers in @a iov in order, like readv(2), blocking until
+     *  they are full (or end-of-file or an error condition).  The @a iov
+     *  array itself is copied and need not outlive the call, but the buffers
+     *  it points to must stay valid until @a done is triggered.  @a done is
+     *  triggered with 0 on success or end-of-file, or a negative error code.
+     *  @a nread is kept up to date as the read progresses.
+     */
+    inline void readv(const struct iovec *iov, int iovcnt, size_t &nread,
+		      event<int> done);
+
+    /** @brief  Read from file descriptor into several buffers.
+     *
+     *  Similar to readv(const struct iovec *, int, size_t &, event<int>), but
+     *  does not return the number of characters actually read.
+     */
+    inline void readv(const struct iovec *iov, int iovcnt,
+		      const event<int> &done);
+
     /** @brief  Write to file descriptor.
      *  @param       buf       Buffer.
      *  @param       size      Buffer size.
@@ -383,6 +408,31 @@ class fd {
      */
     inline void write(const std::string &buf, const event<int> &done);
 
+    /** @brief  Write several buffers to file descriptor.
+     *  @param       iov       Buffer array.
+     *  @param       iovcnt    Number of buffers.
+     *  @param[out]  nwritten  Number of characters written.
+     *  @param       done      Event triggered on completion.
+     *
+     *  Writes the buffers in @a iov in order, like writev(2), so that a
+     *  header and a body in separate buffers go out in one system call.
+     *  Partial writes resume where they stopped without copying data.  The
+     *  @a iov array itself is copied and need not outlive the call, but the
+     *  buffers it points to must stay valid until @a done is triggered.  @a
+     *  done is triggered with 0 on success or end-of-file, or a negative
+     *  error code.  @a nwritten is kept up to date as the write progresses.
+     */
+    inline void writev(const struct iovec *iov, int iovcnt, size_t &nwritten,
+		       event<int> done);
+
+    /** @brief  Write several buffers to file descriptor.
+     *
+     *  Similar to writev(const struct iovec *, int, size_t &, event<int>),
+     *  but does not return the number of characters actually written.
+     */
+    inline void writev(const struct iovec *iov, int iovcnt,
+		       const event<int> &done);
+
     /** @brief  Write once to file descriptor.
      *  @param       buf       Buffer.
      *  @param       size      Buffer size.
@@ -401,6 +451,47 @@ class fd {
     inline void write_once(const void *buf, size_t size, size_t &nwritten,
 			   event<int> done);
 
+    /** @brief  Send file data to this file descriptor.
+     *  @param       src    Source file.
+     *  @param       off    Offset in @a src.
+     *  @param       size   Number of bytes to send.
+     *  @param[out]  nsent  Number of bytes sent.
+     *  @param       done   Event triggered on completion.
+     *
+     *  Writes @a size bytes, starting at offset @a off in @a src, to this
+     *  file descriptor without copying them through user space.  The file
+     *  position of @a src is unchanged.  Uses sendfile(2) where available,
+     *  and otherwise falls back to pread(2) and write(2).  @a done is
+     *  triggered with 0 on success or end-of-file, or a negative error code.
+     *  @a nsent is kept up to date as the transfer progresses.
+     */
+    inline void sendfile(fd src, off_t off, size_t size, size_t &nsent,
+			 event<int> done);
+
+    /** @brief  Send file data to this file descriptor.
+     *
+     *  Similar to sendfile(fd, off_t, size_t, size_t &, event<int>), but
+     *  does not return the number of bytes actually sent.
+     */
+    inline void sendfile(fd src, off_t off, size_t size,
+			 const event<int> &done);
+
+    /** @brief  Move data from @a src to this file descriptor.
+     *  @param       src        Source file descriptor.
+     *  @param       size       Number of bytes to move.
+     *  @param[out]  nspliced   Number of bytes moved.
+     *  @param       done       Event triggered on completion.
+     *
+     *  Reads up to @a size bytes from @a src and writes them to this file
+     *  descriptor, blocking until @a size bytes are moved (or end-of-file on
+     *  @a src or an error condition).  When one side is a pipe, uses
+     *  splice(2) so data never enters user space; otherwise copies through
+     *  a buffer.  @a done is triggered with 0 on success or end-of-file, or a
+     *  negative error code.
+     */
+    inline void splice(fd src, size_t size, size_t &nspliced,
+		       event<int> done);
+
     /** @brief  Send a message on a file descriptor.
      *  @param  buf          Buffer.
      *  @param  size         Buffer size.
@@ -482,7 +573,19 @@ class fd {
 	void write(const void *buf, size_t size, size_t &nwritten, event<int> done);
 	void write(std::string buf, size_t &nwritten, event<int> done);
 	void write_once(const void *buf, size_t size, size_t &nwritten, event<int> done);
+	bool is_helper_file() const {
+#if HAVE_TAMER_FDHELPER
+	    return _is_file;
+#else
+	    return false;
+#endif
+	}
+	void helper_transfer(bool is_write, void *buf, size_t size, size_t &nxfer, event<int> done);
+	void transferv(bool is_write, const struct iovec *iov, int iovcnt, size_t &nxfer, event<int> done);
 	void sendmsg(const void *buf, size_t size, int fd_to_send, event<int> done);
+	void sendfile(fd src, off_t off, size_t size, size_t &nsent, event<int> done);
+	void splice(fd src, size_t size, size_t &nspliced, event<int> done);
+	void copy(fd src, off_t off, size_t size, size_t &ncopied, event<int> caller, event<int> done);
 	void full_release() {
 	    if (_fd >= 0)
 		close();
@@ -498,7 +601,11 @@ class fd {
 	class closure__write__PKvkRkQi_; void write(closure__write__PKvkRkQi_ &);
 	class closure__write__SsRkQi_; void write(closure__write__SsRkQi_ &);
 	class closure__write_once__PKvkRkQi_; void write_once(closure__write_once__PKvkRkQi_ &);
+	class closure__transferv__bPK5ioveciRkQi_; void transferv(closure__transferv__bPK5ioveciRkQi_ &);
 	class closure__sendmsg__PKvkiQi_; void sendmsg(closure__sendmsg__PKvkiQi_ &);
+	class closure__sendfile__2fd5off_tkRkQi_; void sendfile(closure__sendfile__2fd5off_tkRkQi_ &);
+	class closure__splice__2fdkRkQi_; void splice(closure__splice__2fdkRkQi_ &);
+	class closure__copy__2fd5off_tkRkQi_Qi_; void copy(closure__copy__2fd5off_tkRkQi_Qi_ &);
     };
 
     class closure__open__PKci6mode_tQ2fd_; static void open(closure__open__PKci6mode_tQ2fd_ &);
@@ -645,6 +752,50 @@ inline void fd::write_once(const void *buf, size_t size, size_t &nwritten, event
 	done.trigger(-EBADF);
 }
 
+inline void fd::readv(const struct iovec *iov, int iovcnt, size_t &nread, event<int> done) {
+    nread = 0;
+    if (_p)
+	_p->transferv(false, iov, iovcnt, nread, done);
+    else
+	done.trigger(-EBADF);
+}
+
+inline void fd::readv(const struct iovec *iov, int iovcnt, const event<int> &done) {
+    readv(iov, iovcnt, garbage_size, done);
+}
+
+inline void fd::writev(const struct iovec *iov, int iovcnt, size_t &nwritten, event<int> done) {
+    nwritten = 0;
+    if (_p)
+	_p->transferv(true, iov, iovcnt, nwritten, done);
+    else
+	done.trigger(-EBADF);
+}
+
+inline void fd::writev(const struct iovec *iov, int iovcnt, const event<int> &done) {
+    writev(iov, iovcnt, garbage_size, done);
+}
+
+inline void fd::sendfile(fd src, off_t off, size_t size, size_t &nsent, event<int> done) {
+    nsent = 0;
+    if (_p)
+	_p->sendfile(src, off, size, nsent, done);
+    else
+	done.trigger(-EBADF);
+}
+
+inline void fd::sendfile(fd src, off_t off, size_t size, const event<int> &done) {
+    sendfile(src, off, size, garbage_size, done);
+}
+
+inline void fd::splice(fd src, size_t size, size_t &nspliced, event<int> done) {
+    nspliced = 0;
+    if (_p)
+	_p->splice(src, size, nspliced, done);
+    else
+	done.trigger(-EBADF);
+}
+
 inline void fd::sendmsg(const void *buf, size_t size, int transfer_fd, event<int> done) {
     if (_p)
 	_p->sendmsg(buf, size, transfer_fd, done);
@@ -719,6 +870,19 @@ inline void tcp_listen(int port, event<fd> result) {
 }
 
 
+/** @brief  Open a nonblocking TCP listener that can share port @a port.
+ *  @param  port     Listening port (in host byte order).
+ *  @param  backlog  Maximum connection backlog.
+ *  @param  result   Event triggered on completion.
+ *
+ *  Like tcp_listen(), but also sets @c SO_REUSEPORT, so several listeners
+ *  (typically one per loop_threads() loop) can bind the same port and the
+ *  kernel balances incoming connections among them. Returns an error of
+ *  -ENOPROTOOPT if the system lacks @c SO_REUSEPORT.
+ */
+void tcp_listen_shared(int port, int backlog, event<fd> result);
+
+
 /** @brief  Create a nonblocking TCP connection to @a addr:@a port.
  *  @param  addr    Remote host.
  *  @param  port    Remote port (in host byte order).
@@ -731,6 +895,11 @@ inline void tcp_listen(int port, event<fd> result) {
  */
 void tcp_connect(struct in_addr addr, int port, event<fd> result);
 
+/** @brief  Create a nonblocking TCP connection to IPv6 address @a addr:@a port.
+ *  @overload
+ */
+void tcp_connect(const struct in6_addr &addr, int port, event<fd> result);
+
 void udp_connect(struct in_addr addr, int port, event<fd> result);
 
 
@@ -4,14 +4,84 @@
 #include <tamer/lock.hh>
 #include <tamer/ref.hh>
 #include <tamer/fd.hh>
-#include <tamer/fdhmsg.hh>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <limits.h>
 #include <stdio.h>
 #include <list>
+#if TAMER_FDHELPER_THREADS
+# include <deque>
+# include <map>
+# include <vector>
+#else
+# include <tamer/fdhmsg.hh>
+#endif
 namespace tamer {
 
+#if TAMER_FDHELPER_THREADS
+class fdhelper { public:
+
+    fdhelper()
+	: _p(new fdhimp(0)) {
+    }
+    explicit fdhelper(int concurrency)
+	: _p(new fdhimp(concurrency)) {
+    }
+
+    void open(const std::string &fname, int flags, mode_t mode,
+	      const event<int> &fd) {
+	_p->open(fname, flags, mode, fd);
+    }
+    void fstat(int fd, struct stat &stat_out, const event<int> &done) {
+	_p->fstat(fd, stat_out, done);
+    }
+    void read(int fd, void *buf, size_t size, size_t &nread, const event<int> &done) {
+	_p->enqueue(fd, false, buf, size, nread, done);
+    }
+    void write(int fd, const void *buf, size_t size, size_t &nwritten, const event<int> &done) {
+	_p->enqueue(fd, true, const_cast<void *>(buf), size, nwritten, done);
+    }
+
+  private:
+
+    struct fdreq {
+	bool is_write;
+	void *buf;
+	size_t size;
+	size_t *nxfer;
+	event<int> done;
+    };
+    struct fdbatch;
+    struct fdxfer;
+
+    struct fdhimp : public enable_ref_ptr {
+	int _max;
+	int _active;
+	std::list<event<> > _waiting;
+	std::map<int, std::deque<fdreq> > _files;
+
+	fdhimp(int concurrency);
+
+	void get(event<> done);
+	void put();
+
+	void open(std::string fname, int flags, mode_t mode, event<int> fd);
+	void fstat(int fd, struct stat &stat_out, event<int> done);
+	void enqueue(int fd, bool is_write, void *buf, size_t size,
+		     size_t &nxfer, const event<int> &done);
+	void run(int fd);
+
+	class closure__get__Q_; void get(closure__get__Q_ &);
+	class closure__open__Ssi6mode_tQi_; void open(closure__open__Ssi6mode_tQi_ &);
+	class closure__fstat__iR4statQi_; void fstat(closure__fstat__iR4statQi_ &);
+	class closure__run__i; void run(closure__run__i &);
+
+    };
+
+    ref_ptr<fdhimp> _p;
+
+};
+#else
 class fdhelper { public:
 
     fdhelper()
@@ -91,6 +161,7 @@ class fdhelper { public:
     ref_ptr<fdhimp> _p;
 
 };
+#endif
 
 }
 #endif /* TAMER_FDH_HH */
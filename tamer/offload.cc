@@ -0,0 +1,251 @@
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include "config.h"
+#include <tamer/tamer.hh>
+#include <tamer/offload.hh>
+#include <unistd.h>
+#include <errno.h>
+#if HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+namespace tamer {
+namespace tamerpriv {
+
+#if HAVE_PTHREAD_H
+namespace {
+
+// Each worker owns a bounded deque. Submitters push onto the back of some
+// worker's deque; the owner pops from the back (most recent first, which is
+// friendliest to its cache) and thieves take from the front. Deques are
+// short critical sections behind per-deque locks, so submitters and thieves
+// rarely contend with one another.
+
+struct offload_deque {
+    pthread_mutex_t lock_;
+    offload_job **jobs_;
+    unsigned head_;
+    unsigned tail_;
+    unsigned capmask_;
+
+    void initialize(unsigned capacity) {
+	pthread_mutex_init(&lock_, 0);
+	unsigned cap = 1;
+	while (cap < capacity)
+	    cap *= 2;
+	jobs_ = new offload_job *[cap];
+	head_ = tail_ = 0;
+	capmask_ = cap - 1;
+    }
+    bool push_back(offload_job *j) {
+	pthread_mutex_lock(&lock_);
+	bool ok = tail_ - head_ <= capmask_;
+	if (ok) {
+	    jobs_[tail_ & capmask_] = j;
+	    ++tail_;
+	}
+	pthread_mutex_unlock(&lock_);
+	return ok;
+    }
+    offload_job *pop_back() {
+	offload_job *j = 0;
+	pthread_mutex_lock(&lock_);
+	if (head_ != tail_) {
+	    --tail_;
+	    j = jobs_[tail_ & capmask_];
+	}
+	pthread_mutex_unlock(&lock_);
+	return j;
+    }
+    offload_job *pop_front() {
+	offload_job *j = 0;
+	pthread_mutex_lock(&lock_);
+	if (head_ != tail_) {
+	    j = jobs_[head_ & capmask_];
+	    ++head_;
+	}
+	pthread_mutex_unlock(&lock_);
+	return j;
+    }
+};
+
+struct offload_pool {
+    int nworkers_;
+    offload_deque *deques_;
+    pthread_mutex_t idle_lock_;
+    pthread_cond_t idle_cond_;
+    int nidle_;			// accessed atomically
+    int npending_;		// accessed atomically
+
+    int start(int nthreads, int capacity);
+    offload_job *take(int self);
+    bool submit(offload_job *j);
+};
+
+struct offload_worker_info {
+    offload_pool *pool;
+    int index;
+};
+
+offload_pool *pool;
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+TAMER_THREAD_LOCAL unsigned submit_cursor;
+TAMER_THREAD_LOCAL offload_job *overflow_head;
+TAMER_THREAD_LOCAL offload_job *overflow_tail;
+
+offload_job *offload_pool::take(int self) {
+    offload_job *j = deques_[self].pop_back();
+    for (int i = 1; !j && i < nworkers_; ++i)
+	j = deques_[(self + i) % nworkers_].pop_front();
+    if (j)
+	__atomic_sub_fetch(&npending_, 1, __ATOMIC_SEQ_CST);
+    return j;
+}
+
+extern "C" void *offload_worker(void *x) {
+    offload_worker_info *info = static_cast<offload_worker_info *>(x);
+    offload_pool *p = info->pool;
+    int self = info->index;
+    delete info;
+    while (1) {
+	if (offload_job *j = p->take(self)) {
+	    j->run();
+	    remote_post(j);
+	    continue;
+	}
+	pthread_mutex_lock(&p->idle_lock_);
+	__atomic_add_fetch(&p->nidle_, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(&p->npending_, __ATOMIC_SEQ_CST) == 0)
+	    pthread_cond_wait(&p->idle_cond_, &p->idle_lock_);
+	__atomic_sub_fetch(&p->nidle_, 1, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&p->idle_lock_);
+    }
+}
+
+int offload_pool::start(int nthreads, int capacity) {
+    if (nthreads <= 0) {
+#ifdef _SC_NPROCESSORS_ONLN
+	nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (nthreads <= 0)
+	    nthreads = 1;
+    }
+    if (capacity <= 0)
+	capacity = 1;
+    nworkers_ = nthreads;
+    deques_ = new offload_deque[nthreads];
+    for (int i = 0; i < nthreads; ++i)
+	deques_[i].initialize(capacity);
+    pthread_mutex_init(&idle_lock_, 0);
+    pthread_cond_init(&idle_cond_, 0);
+    nidle_ = npending_ = 0;
+
+    for (int i = 0; i < nthreads; ++i) {
+	offload_worker_info *info = new offload_worker_info;
+	info->pool = this;
+	info->index = i;
+	pthread_t thread;
+	int r = pthread_create(&thread, 0, offload_worker, info);
+	if (r != 0) {
+	    delete info;
+	    if (i == 0)
+		return -r;
+	    nworkers_ = i;	// keep the workers we have
+	    break;
+	}
+	pthread_detach(thread);
+    }
+    return 0;
+}
+
+bool offload_pool::submit(offload_job *j) {
+    unsigned start = submit_cursor++;
+    int i;
+    for (i = 0; i < nworkers_; ++i)
+	if (deques_[(start + i) % nworkers_].push_back(j))
+	    break;
+    if (i == nworkers_)
+	return false;
+    __atomic_add_fetch(&npending_, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&nidle_, __ATOMIC_SEQ_CST) != 0) {
+	pthread_mutex_lock(&idle_lock_);
+	pthread_cond_signal(&idle_cond_);
+	pthread_mutex_unlock(&idle_lock_);
+    }
+    return true;
+}
+
+offload_pool *get_pool() {
+    if (!__atomic_load_n(&pool, __ATOMIC_ACQUIRE))
+	offload_initialize();
+    return pool;
+}
+
+}
+#endif
+
+void offload_job::deliver(remote_node *n) {
+    offload_job *j = static_cast<offload_job *>(n);
+    j->complete();
+    delete j;
+#if HAVE_PTHREAD_H
+    // a deque slot is free now; resubmit jobs that found the pool full
+    while (overflow_head && pool->submit(overflow_head))
+	if (!(overflow_head = overflow_head->qnext_))
+	    overflow_tail = 0;
+#endif
+}
+
+void offload_submit(offload_job *j) {
+#if HAVE_PTHREAD_H
+    if (offload_pool *p = get_pool()) {
+	remote_register(j);
+	if (overflow_head || !p->submit(j)) {
+	    j->qnext_ = 0;
+	    if (overflow_tail)
+		overflow_tail->qnext_ = j;
+	    else
+		overflow_head = j;
+	    overflow_tail = j;
+	}
+	return;
+    }
+#endif
+    j->run();
+    j->complete();
+    delete j;
+}
+
+}
+
+int offload_initialize(int nthreads, int capacity) {
+#if HAVE_PTHREAD_H
+    using tamerpriv::pool;
+    pthread_mutex_lock(&tamerpriv::pool_lock);
+    int r = -EBUSY;
+    if (!pool) {
+	tamerpriv::offload_pool *p = new tamerpriv::offload_pool;
+	if ((r = p->start(nthreads, capacity)) == 0)
+	    __atomic_store_n(&pool, p, __ATOMIC_RELEASE);
+	else
+	    delete p;
+    }
+    pthread_mutex_unlock(&tamerpriv::pool_lock);
+    return r;
+#else
+    (void) nthreads, (void) capacity;
+    return -ENOSYS;
+#endif
+}
+
+}
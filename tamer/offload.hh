@@ -0,0 +1,116 @@
+#ifndef TAMER_OFFLOAD_HH
+#define TAMER_OFFLOAD_HH 1
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <tamer/remote.hh>
+namespace tamer {
+
+/** @file <tamer/offload.hh>
+ *  @brief  Running blocking or CPU-bound work on a thread pool.
+ */
+
+namespace tamerpriv {
+class offload_job : public remote_node { public:
+    offload_job *qnext_;
+
+    offload_job() {
+	deliver_ = deliver;
+    }
+    virtual ~offload_job() {
+    }
+
+    virtual void run() = 0;		// on a worker thread
+    virtual void complete() = 0;	// on the submitting thread
+
+    static void deliver(remote_node *n);
+};
+
+void offload_submit(offload_job *j);
+
+template <typename F, typename R>
+class offload_value_job : public offload_job { public:
+    offload_value_job(const F &f, const event<R> &done)
+	: f_(f), done_(done), result_() {
+    }
+    void run() {
+	result_ = f_();
+    }
+    void complete() {
+	done_.trigger(result_);
+    }
+  private:
+    F f_;
+    event<R> done_;
+    R result_;
+};
+
+template <typename F>
+class offload_void_job : public offload_job { public:
+    offload_void_job(const F &f, const event<> &done)
+	: f_(f), done_(done) {
+    }
+    void run() {
+	f_();
+    }
+    void complete() {
+	done_.trigger();
+    }
+  private:
+    F f_;
+    event<> done_;
+};
+}
+
+/** @brief  Configure the offload thread pool.
+ *  @param  nthreads  Number of worker threads, or 0 for one per online
+ *                    processor.
+ *  @param  capacity  Maximum number of queued jobs per worker.
+ *  @return  0 on success, or a negative error code. Returns -EBUSY if the
+ *  pool is already running.
+ *
+ *  Calling this function is optional; the first offload() starts a pool with
+ *  default settings. Worker threads run for the life of the process.
+ */
+int offload_initialize(int nthreads = 0, int capacity = 256);
+
+/** @brief  Run @a f on a worker thread and deliver its result to @a done.
+ *  @param  f     Function object called as <code>f()</code>.
+ *  @param  done  Event triggered with <code>f()</code>'s return value.
+ *
+ *  @a f runs on one of the offload pool's worker threads, so it must not
+ *  touch Tamer events, rendezvous, or file descriptor objects. @a done is
+ *  triggered later on the calling thread's driver, which stays nonempty
+ *  until the result arrives. @a f runs even if @a done has been canceled
+ *  in the meantime.
+ *
+ *  Each worker owns a bounded deque of jobs, and idle workers steal from
+ *  their neighbors. When every deque is full, further jobs wait on the
+ *  calling thread until earlier jobs complete. Without thread support, @a f
+ *  runs immediately on the calling thread.
+ */
+template <typename F, typename R>
+inline void offload(const F &f, const event<R> &done) {
+    tamerpriv::offload_submit(new tamerpriv::offload_value_job<F, R>(f, done));
+}
+
+/** @brief  Run @a f on a worker thread and trigger @a done when it returns.
+ *
+ *  The return value of <code>f()</code>, if any, is ignored.
+ */
+template <typename F>
+inline void offload(const F &f, const event<> &done) {
+    tamerpriv::offload_submit(new tamerpriv::offload_void_job<F>(f, done));
+}
+
+}
+#endif /* TAMER_OFFLOAD_HH */
@@ -0,0 +1,175 @@
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include "config.h"
+#include <tamer/tamer.hh>
+#include <tamer/remote.hh>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_SYS_EVENTFD_H
+# include <sys/eventfd.h>
+#endif
+
+namespace tamer {
+namespace tamerpriv {
+
+// Each thread that creates remote_events has an inbox. Other threads push
+// triggered nodes onto a lock-free stack (multiple producers, one consumer)
+// and kick the inbox's wake descriptor when the stack was empty. The owning
+// driver watches that descriptor like any other file descriptor, so no
+// driver needs special support.
+
+struct remote_inbox : public functional_rendezvous {
+    remote_node *head_;		// accessed atomically
+    int fd_[2];			// read end, write end
+    unsigned outstanding_;
+    bool armed_;
+
+    remote_inbox();
+
+    inline void add(simple_event *e, uintptr_t) TAMER_NOEXCEPT {
+	e->initialize(this, 0);
+    }
+    void arm();
+    void kick() TAMER_NOEXCEPT;
+    void drain() TAMER_NOEXCEPT;
+    static void hook(functional_rendezvous *fr,
+		     simple_event *e, bool values) TAMER_NOEXCEPT;
+};
+
+namespace {
+TAMER_THREAD_LOCAL remote_inbox *current_inbox;
+}
+
+remote_inbox::remote_inbox()
+    : functional_rendezvous(hook), head_(0), outstanding_(0), armed_(false) {
+#if HAVE_SYS_EVENTFD_H
+    fd_[0] = fd_[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd_[0] >= 0)
+	return;
+#endif
+    if (pipe(fd_) != 0) {
+	fprintf(stderr, "tamer: cannot create remote event pipe: %s\n",
+		strerror(errno));
+	abort();
+    }
+    for (int i = 0; i < 2; ++i) {
+	fcntl(fd_[i], F_SETFL, O_NONBLOCK);
+	fcntl(fd_[i], F_SETFD, FD_CLOEXEC);
+    }
+}
+
+void remote_inbox::arm() {
+    armed_ = true;
+    driver::main->at_fd_read(fd_[0], event<>(*this, 0));
+}
+
+void remote_inbox::kick() TAMER_NOEXCEPT {
+    ssize_t r;
+    if (fd_[0] == fd_[1]) {
+	uint64_t x = 1;
+	r = write(fd_[1], &x, sizeof(x));
+    } else
+	r = write(fd_[1], "", 1);
+    (void) r;
+}
+
+void remote_inbox::drain() TAMER_NOEXCEPT {
+    char buf[64];
+    if (fd_[0] == fd_[1])
+	(void) read(fd_[0], buf, sizeof(uint64_t));
+    else
+	while (read(fd_[0], buf, sizeof(buf)) > 0)
+	    /* do nothing */;
+}
+
+void remote_inbox::hook(functional_rendezvous *fr,
+			simple_event *, bool values) TAMER_NOEXCEPT {
+    remote_inbox *ib = static_cast<remote_inbox *>(fr);
+    ib->armed_ = false;
+    if (!values)		// the driver is going away
+	return;
+
+    // Clear the wakeup before taking the stack: a producer that pushes
+    // after the exchange sees an empty stack and kicks again.
+    ib->drain();
+    remote_node *n = __atomic_exchange_n(&ib->head_, (remote_node *) 0,
+					 __ATOMIC_ACQUIRE);
+    remote_node *fifo = 0;
+    while (n) {
+	remote_node *next = n->next_;
+	n->next_ = fifo;
+	fifo = n;
+	n = next;
+    }
+    while (fifo) {
+	n = fifo;
+	fifo = n->next_;
+	--ib->outstanding_;
+	n->deliver_(n);
+    }
+
+    if (ib->outstanding_ && !ib->armed_)
+	ib->arm();
+}
+
+void remote_register(remote_node *n) {
+    assert(driver::main);
+    remote_inbox *ib = current_inbox;
+    if (!ib)
+	ib = current_inbox = new remote_inbox;
+    n->owner_ = ib;
+    ++ib->outstanding_;
+    if (!ib->armed_)
+	ib->arm();
+}
+
+// The first handle to claim a node posts it; the claim gives the inbox a
+// reference, which it drops after delivery.
+bool remote_claim(remote_node *n) TAMER_NOEXCEPT {
+    bool expected = false;
+    if (!__atomic_compare_exchange_n(&n->claimed_, &expected, true, false,
+				     __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+	return false;
+    __atomic_add_fetch(&n->refcount_, 1, __ATOMIC_RELAXED);
+    return true;
+}
+
+void remote_release(remote_node *n) TAMER_NOEXCEPT {
+    if (__atomic_sub_fetch(&n->refcount_, 1, __ATOMIC_ACQ_REL) != 0)
+	return;
+    if (__atomic_load_n(&n->claimed_, __ATOMIC_ACQUIRE))
+	delete n;
+    else {
+	// every handle is gone and none fired: unblock the owner's event
+	n->claimed_ = true;
+	n->refcount_ = 1;
+	remote_post(n);
+    }
+}
+
+void remote_post(remote_node *n) TAMER_NOEXCEPT {
+    remote_inbox *ib = n->owner_;
+    remote_node *h = __atomic_load_n(&ib->head_, __ATOMIC_RELAXED);
+    do {
+	n->next_ = h;
+    } while (!__atomic_compare_exchange_n(&ib->head_, &h, n, true,
+					  __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    if (!h)
+	ib->kick();
+}
+
+}}
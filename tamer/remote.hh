@@ -0,0 +1,234 @@
+#ifndef TAMER_REMOTE_HH
+#define TAMER_REMOTE_HH 1
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <tamer/event.hh>
+namespace tamer {
+
+/** @file <tamer/remote.hh>
+ *  @brief  Events that may be triggered from other threads.
+ */
+
+namespace tamerpriv {
+struct remote_inbox;
+
+struct remote_node {
+    remote_node *next_;
+    remote_inbox *owner_;
+    void (*deliver_)(remote_node *);
+    unsigned refcount_;		// handles, plus the inbox once posted
+    bool claimed_;		// some handle has triggered or unblocked
+    remote_node()
+	: refcount_(1), claimed_(false) {
+    }
+    virtual ~remote_node() {
+    }
+};
+
+void remote_register(remote_node *n);
+bool remote_claim(remote_node *n) TAMER_NOEXCEPT;
+void remote_post(remote_node *n) TAMER_NOEXCEPT;
+void remote_release(remote_node *n) TAMER_NOEXCEPT;
+
+inline void remote_use(remote_node *n) TAMER_NOEXCEPT {
+    if (n)
+	__atomic_add_fetch(&n->refcount_, 1, __ATOMIC_RELAXED);
+}
+}
+
+/** @class remote_event tamer/remote.hh <tamer/remote.hh>
+ *  @brief  A handle for triggering an event from another thread.
+ *
+ *  Tamer events are not thread safe: an event<T0> must be triggered by the
+ *  thread whose driver owns it.  A remote_event wraps an event so that any
+ *  thread may trigger it.  The remote_event is created on the owning thread.
+ *  Calling trigger() on any thread queues the value for the owning driver,
+ *  which wakes up (if it was blocked) and triggers the wrapped event from
+ *  its own loop.
+ *
+ *  @code
+ *     tamed void digest(const char *data, size_t len, tamer::event<int> e) {
+ *         // runs on the event loop
+ *         start_worker(data, len, tamer::remote_event<int>(e));
+ *     }
+ *     void worker(..., tamer::remote_event<int> re) {
+ *         // runs on a worker thread
+ *         re.trigger(compute(...));
+ *     }
+ *  @endcode
+ *
+ *  Copies of a remote_event share a single trigger: the first trigger() or
+ *  unblock() on any copy wins, and later calls are ignored.  If the last
+ *  copy is destroyed before that, the wrapped event is unblocked.  The
+ *  owning driver is nonempty until the wrapped event has been delivered.
+ */
+template <typename T0 = void>
+class remote_event { public:
+
+    /** @brief  Default constructor creates an empty remote_event. */
+    inline remote_event()
+	: n_(0) {
+    }
+
+    /** @brief  Wrap @a e for triggering from any thread.
+     *
+     *  Must be called on the thread that owns @a e. */
+    explicit inline remote_event(const event<T0> &e)
+	: n_(new node(e)) {
+	tamerpriv::remote_register(n_);
+    }
+
+    inline remote_event(const remote_event<T0> &x)
+	: n_(x.n_) {
+	tamerpriv::remote_use(n_);
+    }
+
+    inline ~remote_event() {
+	if (n_)
+	    tamerpriv::remote_release(n_);
+    }
+
+    inline remote_event<T0> &operator=(const remote_event<T0> &x) {
+	tamerpriv::remote_use(x.n_);
+	if (n_)
+	    tamerpriv::remote_release(n_);
+	n_ = x.n_;
+	return *this;
+    }
+
+    /** @brief  Test if this remote_event has already been used. */
+    inline bool empty() const {
+	return !n_;
+    }
+
+    /** @brief  Trigger the wrapped event with value @a v0.
+     *
+     *  Safe to call from any thread. The wrapped event is triggered later,
+     *  from the owning driver's loop. Does nothing if empty() or if a copy
+     *  was already used. */
+    inline void trigger(const T0 &v0) {
+	if (n_ && tamerpriv::remote_claim(n_)) {
+	    n_->v0_ = v0;
+	    n_->triggered_ = true;
+	    tamerpriv::remote_post(n_);
+	}
+	clear();
+    }
+
+    /** @brief  Unblock the wrapped event without setting its value. */
+    inline void unblock() {
+	if (n_ && tamerpriv::remote_claim(n_))
+	    tamerpriv::remote_post(n_);
+	clear();
+    }
+
+  private:
+
+    struct node : public tamerpriv::remote_node {
+	event<T0> e_;
+	T0 v0_;
+	bool triggered_;
+	node(const event<T0> &e)
+	    : e_(e), v0_(), triggered_(false) {
+	    deliver_ = deliver;
+	}
+    };
+
+    node *n_;
+
+    inline void clear() {
+	if (n_)
+	    tamerpriv::remote_release(n_);
+	n_ = 0;
+    }
+
+    static void deliver(tamerpriv::remote_node *rn) {
+	node *n = static_cast<node *>(rn);
+	// leave e_ empty: a handle on another thread may free the node
+	if (n->triggered_)
+	    n->e_.trigger(n->v0_);
+	else
+	    tamerpriv::simple_event::simple_trigger(n->e_.__take_simple(), false);
+	tamerpriv::remote_release(n);
+    }
+
+};
+
+template <>
+class remote_event<void> { public:
+
+    inline remote_event()
+	: n_(0) {
+    }
+
+    explicit inline remote_event(const event<> &e)
+	: n_(new node(e)) {
+	tamerpriv::remote_register(n_);
+    }
+
+    inline remote_event(const remote_event<void> &x)
+	: n_(x.n_) {
+	tamerpriv::remote_use(n_);
+    }
+
+    inline ~remote_event() {
+	if (n_)
+	    tamerpriv::remote_release(n_);
+    }
+
+    inline remote_event<void> &operator=(const remote_event<void> &x) {
+	tamerpriv::remote_use(x.n_);
+	if (n_)
+	    tamerpriv::remote_release(n_);
+	n_ = x.n_;
+	return *this;
+    }
+
+    inline bool empty() const {
+	return !n_;
+    }
+
+    inline void trigger() {
+	if (n_ && tamerpriv::remote_claim(n_))
+	    tamerpriv::remote_post(n_);
+	if (n_)
+	    tamerpriv::remote_release(n_);
+	n_ = 0;
+    }
+
+    inline void unblock() {
+	trigger();
+    }
+
+  private:
+
+    struct node : public tamerpriv::remote_node {
+	event<> e_;
+	node(const event<> &e)
+	    : e_(e) {
+	    deliver_ = deliver;
+	}
+    };
+
+    node *n_;
+
+    static void deliver(tamerpriv::remote_node *rn) {
+	node *n = static_cast<node *>(rn);
+	n->e_.trigger();
+	tamerpriv::remote_release(n);
+    }
+
+};
+
+}
+#endif /* TAMER_REMOTE_HH */
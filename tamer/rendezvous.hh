@@ -14,8 +14,80 @@
  * legally binding.
  */
 #include <cassert>
+#include <new>
 #include <tamer/xbase.hh>
 namespace tamer {
+namespace tamerpriv {
+
+// Storage for a rendezvous's event IDs. Slots released by join() are
+// reused by later events; memory is returned when the rendezvous dies.
+template <typename T>
+class rid_arena { public:
+
+    inline rid_arena()
+	: free_(0), chunks_(0), ncap_(0) {
+    }
+    inline ~rid_arena();
+
+    inline void *allocate() {
+	if (!free_)
+	    expand();
+	slot *s = free_;
+	free_ = s->next;
+	return s;
+    }
+    inline void deallocate(T *x) {
+	x->~T();
+	slot *s = reinterpret_cast<slot *>(x);
+	s->next = free_;
+	free_ = s;
+    }
+
+  private:
+
+    union slot {
+	slot *next;
+	char data[sizeof(T)];
+	void *align_p;
+	long long align_ll;
+	double align_d;
+    };
+
+    struct chunk {
+	chunk *next;
+	slot s[1];
+    };
+
+    slot *free_;
+    chunk *chunks_;
+    unsigned ncap_;
+
+    void expand();
+
+};
+
+template <typename T>
+inline rid_arena<T>::~rid_arena() {
+    while (chunk *c = chunks_) {
+	chunks_ = c->next;
+	delete[] reinterpret_cast<char *>(c);
+    }
+}
+
+template <typename T>
+void rid_arena<T>::expand() {
+    unsigned n = (ncap_ ? ncap_ : 8);
+    chunk *c = reinterpret_cast<chunk *>(new char[sizeof(chunk) + sizeof(slot) * (n - 1)]);
+    c->next = chunks_;
+    chunks_ = c;
+    for (unsigned i = n; i != 0; --i) {
+	c->s[i - 1].next = free_;
+	free_ = &c->s[i - 1];
+    }
+    ncap_ += n;
+}
+
+}
 
 /** @file <tamer/rendezvous.hh>
  *  @brief  The rendezvous template classes.
@@ -102,6 +174,8 @@ class rendezvous : public tamerpriv::explicit_rendezvous { public:
 	}
     };
 
+    tamerpriv::rid_arena<eventid> ids_;
+
 };
 
 template <typename I0, typename I1>
@@ -120,7 +194,7 @@ inline rendezvous<I0, I1>::~rendezvous()
 template <typename I0, typename I1>
 inline void rendezvous<I0, I1>::add(tamerpriv::simple_event *e, const I0 &i0, const I1 &i1)
 {
-    eventid *eid = new eventid(i0, i1);
+    eventid *eid = new(ids_.allocate()) eventid(i0, i1);
     e->initialize(this, reinterpret_cast<uintptr_t>(eid));
 }
 
@@ -131,7 +205,7 @@ inline bool rendezvous<I0, I1>::join(I0 &i0, I1 &i1)
 	eventid *eid = reinterpret_cast<eventid *>(pop_ready());
 	i0 = TAMER_MOVE(eid->i0);
 	i1 = TAMER_MOVE(eid->i1);
-	delete eid;
+	ids_.deallocate(eid);
 	return true;
     } else
 	return false;
@@ -141,10 +215,10 @@ template <typename I0, typename I1>
 void rendezvous<I0, I1>::clear()
 {
     for (tamerpriv::simple_event *e = waiting_; e; e = e->next())
-	delete reinterpret_cast<eventid *>(e->rid());
+	ids_.deallocate(reinterpret_cast<eventid *>(e->rid()));
     abstract_rendezvous::remove_waiting();
     for (tamerpriv::simple_event *e = ready_; e; e = e->next())
-	delete reinterpret_cast<eventid *>(e->rid());
+	ids_.deallocate(reinterpret_cast<eventid *>(e->rid()));
     explicit_rendezvous::remove_ready();
 }
 
@@ -172,6 +246,10 @@ class rendezvous<I0, void> : public tamerpriv::explicit_rendezvous { public:
 
     inline void add(tamerpriv::simple_event *e, const I0 &i0);
 
+  private:
+
+    tamerpriv::rid_arena<I0> ids_;
+
 };
 
 template <typename I0>
@@ -190,7 +268,7 @@ inline rendezvous<I0, void>::~rendezvous()
 template <typename I0>
 inline void rendezvous<I0, void>::add(tamerpriv::simple_event *e, const I0 &i0)
 {
-    I0 *eid = new I0(i0);
+    I0 *eid = new(ids_.allocate()) I0(i0);
     e->initialize(this, reinterpret_cast<uintptr_t>(eid));
 }
 
@@ -200,7 +278,7 @@ inline bool rendezvous<I0, void>::join(I0 &i0)
     if (ready_) {
 	I0 *eid = reinterpret_cast<I0 *>(pop_ready());
 	i0 = TAMER_MOVE(*eid);
-	delete eid;
+	ids_.deallocate(eid);
 	return true;
     } else
 	return false;
@@ -210,10 +288,10 @@ template <typename I0>
 void rendezvous<I0, void>::clear()
 {
     for (tamerpriv::simple_event *e = waiting_; e; e = e->next())
-	delete reinterpret_cast<I0 *>(e->rid());
+	ids_.deallocate(reinterpret_cast<I0 *>(e->rid()));
     abstract_rendezvous::remove_waiting();
     for (tamerpriv::simple_event *e = ready_; e; e = e->next())
-	delete reinterpret_cast<I0 *>(e->rid());
+	ids_.deallocate(reinterpret_cast<I0 *>(e->rid()));
     explicit_rendezvous::remove_ready();
 }
 
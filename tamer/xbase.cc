@@ -61,16 +61,46 @@ void distribute_rendezvous::complete(tamer::tamerpriv::simple_event *e) TAMER_NO
 namespace tamer {
 namespace tamerpriv {
 
-abstract_rendezvous *abstract_rendezvous::unblocked = 0;
-abstract_rendezvous **abstract_rendezvous::unblocked_ptail = &unblocked;
+TAMER_THREAD_LOCAL simple_event_pool::state simple_event_pool::s_;
+
+void *simple_event_pool::hard_allocate() {
+    enum { slab_size = 16384 };
+    size_t n = slab_size / sizeof(simple_event);
+    char *slab = reinterpret_cast<char *>(::operator new(n * sizeof(simple_event)));
+    state &st = s_;
+    for (size_t i = n - 1; i > 0; --i) {
+	slot *s = reinterpret_cast<slot *>(slab + i * sizeof(simple_event));
+	s->next = st.free;
+	st.free = s;
+    }
+    ++st.nslabs;
+    st.capacity += n;
+    ++st.nused;
+    return slab;
+}
+
+void simple_event_pool::statistics(event_pool_stats &stats) {
+#if TAMER_NOEVENTPOOL
+    stats.slabs = stats.capacity = stats.used = 0;
+#else
+    stats.slabs = s_.nslabs;
+    stats.capacity = s_.capacity;
+    stats.used = s_.nused;
+#endif
+}
+
+TAMER_THREAD_LOCAL abstract_rendezvous *abstract_rendezvous::unblocked;
+TAMER_THREAD_LOCAL abstract_rendezvous *abstract_rendezvous::unblocked_last;
 
 void abstract_rendezvous::hard_free() {
     if (unblocked_next_ != unblocked_sentinel()) {
-	abstract_rendezvous **p = &unblocked;
-	while (*p != this)
-	    p = &(*p)->unblocked_next_;
+	abstract_rendezvous **p = &unblocked, *prev = 0;
+	while (*p != this) {
+	    prev = *p;
+	    p = &prev->unblocked_next_;
+	}
 	if (!(*p = unblocked_next_))
-	    unblocked_ptail = p;
+	    unblocked_last = prev;
     }
     _blocked_closure->tamer_block_position_ = 1;
     _blocked_closure->tamer_activator_(_blocked_closure);
@@ -192,6 +222,16 @@ void event_prematurely_dereferenced(simple_event *, abstract_rendezvous *r) {
 } // namespace tamer::tamerpriv
 
 
+/** @brief  Return the calling thread's event allocator statistics.
+ *
+ *  All fields are zero if Tamer was configured with --disable-event-pool.
+ */
+event_pool_stats event_pool_statistics() {
+    event_pool_stats stats;
+    tamerpriv::simple_event_pool::statistics(stats);
+    return stats;
+}
+
 /** @brief  Create event that triggers @a e1 and @a e2 when triggered.
  *  @param  e1  First event.
  *  @param  e2  Second event.
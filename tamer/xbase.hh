@@ -40,6 +40,15 @@ class tamer_error : public std::runtime_error { public:
 struct no_slot {
 };
 
+/** @brief  Occupancy of the calling thread's event allocator. */
+struct event_pool_stats {
+    size_t slabs;		///< Number of slabs allocated.
+    size_t capacity;		///< Number of event slots in those slabs.
+    size_t used;		///< Number of slots holding live events.
+};
+
+event_pool_stats event_pool_statistics();
+
 enum rendezvous_flags {
     rnormal,
     rvolatile
@@ -53,6 +62,34 @@ class explicit_rendezvous;
 struct tamer_closure;
 struct tamer_debug_closure;
 
+// Freelist allocator for simple_event. Each thread keeps its own list of
+// free slots, carved from slabs that are never returned to the system; an
+// event freed by another thread joins that thread's list.
+class simple_event_pool { public:
+
+    static inline void *allocate();
+    static inline void deallocate(void *p) TAMER_NOEXCEPT;
+    static void statistics(event_pool_stats &stats);
+
+  private:
+
+    struct slot {
+	slot *next;
+    };
+
+    struct state {
+	slot *free;
+	size_t nslabs;
+	size_t capacity;
+	size_t nused;
+    };
+
+    static TAMER_THREAD_LOCAL state s_;
+
+    static void *hard_allocate();
+
+};
+
 class simple_event { public:
 
     // DO NOT derive from this class!
@@ -76,6 +113,15 @@ class simple_event { public:
     }
 #endif
 
+#if !TAMER_NOEVENTPOOL
+    static inline void *operator new(size_t) {
+	return simple_event_pool::allocate();
+    }
+    static inline void operator delete(void *p) TAMER_NOEXCEPT {
+	simple_event_pool::deallocate(p);
+    }
+#endif
+
     static inline void use(simple_event *e) TAMER_NOEXCEPT {
 	if (e)
 	    ++e->_refcount;
@@ -188,7 +234,7 @@ class abstract_rendezvous {
 	abstract_rendezvous *r = unblocked;
 	if (r) {
 	    if (!(unblocked = r->unblocked_next_))
-		unblocked_ptail = &unblocked;
+		unblocked_last = 0;
 	}
 	return r;
     }
@@ -200,8 +246,9 @@ class abstract_rendezvous {
     bool is_volatile_;
     abstract_rendezvous *unblocked_next_;
 
-    static abstract_rendezvous *unblocked;
-    static abstract_rendezvous **unblocked_ptail;
+    // each thread runs its own queue of unblocked closures
+    static TAMER_THREAD_LOCAL abstract_rendezvous *unblocked;
+    static TAMER_THREAD_LOCAL abstract_rendezvous *unblocked_last;
     static inline abstract_rendezvous *unblocked_sentinel() {
 	return reinterpret_cast<abstract_rendezvous *>(uintptr_t(1));
     }
@@ -346,6 +393,24 @@ inline abstract_rendezvous::~abstract_rendezvous() TAMER_NOEXCEPT {
 	hard_free();
 }
 
+inline void *simple_event_pool::allocate() {
+    state &st = s_;
+    if (slot *s = st.free) {
+	st.free = s->next;
+	++st.nused;
+	return s;
+    } else
+	return hard_allocate();
+}
+
+inline void simple_event_pool::deallocate(void *p) TAMER_NOEXCEPT {
+    state &st = s_;
+    slot *s = static_cast<slot *>(p);
+    s->next = st.free;
+    st.free = s;
+    --st.nused;
+}
+
 inline void simple_event::initialize(abstract_rendezvous *r, uintptr_t rid)
 {
 #if TAMER_DEBUG
@@ -397,9 +462,12 @@ inline void abstract_rendezvous::block(tamer_debug_closure &c,
 
 inline void abstract_rendezvous::unblock() {
     if (_blocked_closure && unblocked_next_ == unblocked_sentinel()) {
-	*unblocked_ptail = this;
+	if (unblocked_last)
+	    unblocked_last->unblocked_next_ = this;
+	else
+	    unblocked = this;
 	unblocked_next_ = 0;
-	unblocked_ptail = &unblocked_next_;
+	unblocked_last = this;
     }
 }
 
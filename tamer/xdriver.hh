@@ -70,16 +70,28 @@ class driver { public:
     virtual bool empty() = 0;
     virtual void once() = 0;
     virtual void loop() = 0;
+    virtual const char *name() const = 0;
 
-    static driver *make_tamer();
+    static driver *make_tamer(int flags = 0);
     static driver *make_libevent();
+    static driver *make_epoll(int flags = 0);
+    static driver *make_io_uring(int flags = 0);
 
-    static driver *main;
+    static TAMER_THREAD_LOCAL driver *main;
 
     static volatile sig_atomic_t sig_any_active;
     static int sig_pipe[2];
+    static driver *sig_driver;
     static void dispatch_signals();
 
+    // Signals are dispatched by the driver that first asked for one.
+    inline bool sig_pending() const {
+	return sig_any_active && sig_driver == this;
+    }
+    inline int sig_fd() const {
+	return sig_driver == this ? sig_pipe[0] : -1;
+    }
+
 };
 
 inline driver::driver() {
@@ -0,0 +1,181 @@
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <vector>
+#include <sys/time.h>
+#include <tamer/tamer.hh>
+#include <tamer/dns.hh>
+
+// The resolver's transaction table. First check insert, lookup and removal,
+// that a full table reports no unused ID, and that 0xFFFF is never handed
+// out. Then measure steady-state churn with many queries outstanding: each
+// operation answers one outstanding query and issues a new one, against
+// either the trans_table or the std::map it replaced.
+// Usage: t21 [table|map] [NOUTSTANDING]
+
+#define NUM_OPS 1000000
+
+using tamer::dns::query;
+using tamer::dns::trans_table;
+
+static int nerr;
+
+#define CHECK(x) do {							\
+	if (!(x)) {							\
+	    fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #x); \
+	    ++nerr;							\
+	}								\
+    } while (0)
+
+static query make_query(uint16_t id) {
+    tamer::dns::request q = tamer::dns::make_request_a("example.com");
+    q->set_trans_id(id);
+    return query(q, tamer::event<tamer::dns::reply>());
+}
+
+static void check_basic() {
+    trans_table t;
+    query u;
+    CHECK(t.size() == 0 && !t.contains(1) && !t.remove(1, u) && !t.pop(u));
+
+    query a = make_query(1), b = make_query(2), c = make_query(3);
+    t.insert(a);
+    t.insert(b);
+    t.insert(c);
+    CHECK(t.size() == 3 && t.contains(1) && t.contains(2) && t.contains(3));
+    CHECK(!t.contains(4) && !t.contains(0xFFFF));
+
+    // removal from the middle leaves the others reachable
+    CHECK(t.remove(2, u) && u.q == b.q);
+    CHECK(t.size() == 2 && !t.contains(2) && !t.remove(2, u));
+    CHECK(t.remove(3, u) && u.q == c.q);
+    CHECK(t.remove(1, u) && u.q == a.q);
+    CHECK(t.size() == 0);
+
+    // a removed ID can be reused
+    t.insert(b);
+    t.erase(2);
+    CHECK(!t.contains(2));
+    t.insert(make_query(2));
+    CHECK(t.pop(u) && u.q->trans_id() == 2 && t.size() == 0);
+}
+
+static void check_full() {
+    trans_table t;
+    std::vector<bool> seen(0x10000, false);
+    query u;
+    srandom(1);
+    for (int i = 0; i < 0xFFFF; ++i) {
+	uint16_t id = t.unused_id();
+	if (id == 0xFFFF || seen[id]) {
+	    fprintf(stderr, "FAIL: unused_id() gave %u with %d in use\n",
+		    id, i);
+	    ++nerr;
+	    return;
+	}
+	seen[id] = true;
+	t.insert(make_query(id));
+    }
+    CHECK(t.size() == 0xFFFF && !seen[0xFFFF]);
+    CHECK(t.unused_id() == 0xFFFF && !t.contains(0xFFFF));
+
+    // with one ID free, unused_id() must find exactly that one
+    CHECK(t.remove(12345, u) && u.q->trans_id() == 12345);
+    CHECK(t.unused_id() == 12345);
+    t.insert(u);
+    CHECK(t.unused_id() == 0xFFFF);
+
+    size_t n = 0;
+    while (t.pop(u))
+	++n;
+    CHECK(n == 0xFFFF && t.size() == 0);
+}
+
+// The std::map the resolver used before, with its retry loop for IDs.
+class map_table { public:
+    uint16_t unused_id() {
+	uint16_t id;
+	do {
+	    id = random() % 0xFFFF;
+	} while (m_.find(id) != m_.end());
+	return id;
+    }
+    void insert(const query &u) {
+	m_[u.q->trans_id()] = u;
+    }
+    bool remove(uint16_t id, query &u) {
+	std::map<uint16_t, query>::iterator it = m_.find(id);
+	if (it == m_.end())
+	    return false;
+	u = it->second;
+	m_.erase(it);
+	return true;
+    }
+  private:
+    std::map<uint16_t, query> m_;
+};
+
+template <typename T>
+static double churn(T &t, int noutstanding) {
+    // ids[] holds the outstanding IDs; answer a random one each time
+    std::vector<uint16_t> ids(noutstanding);
+    query u;
+    srandom(1);
+    for (int i = 0; i < noutstanding; ++i) {
+	ids[i] = t.unused_id();
+	t.insert(make_query(ids[i]));
+    }
+
+    struct timeval t0, t1;
+    gettimeofday(&t0, 0);
+    for (int i = 0; i < NUM_OPS; ++i) {
+	int k = random() % noutstanding;
+	if (!t.remove(ids[k], u))
+	    abort();
+	ids[k] = t.unused_id();
+	u.q->set_trans_id(ids[k]);
+	t.insert(u);
+    }
+    gettimeofday(&t1, 0);
+    timersub(&t1, &t0, &t1);
+    return (t1.tv_sec * 1e9 + t1.tv_usec * 1e3) / NUM_OPS;
+}
+
+int main(int argc, char **argv) {
+    bool use_map = argc > 1 && strcmp(argv[1], "map") == 0;
+    int noutstanding = (argc > 2 ? atoi(argv[2]) : 50000);
+    if (noutstanding < 1 || noutstanding > 0xFFFE)
+	noutstanding = 50000;
+
+    check_basic();
+    check_full();
+    if (nerr) {
+	printf("FAILED\n");
+	return 1;
+    }
+
+    double ns;
+    if (use_map) {
+	map_table t;
+	ns = churn(t, noutstanding);
+    } else {
+	trans_table t;
+	ns = churn(t, noutstanding);
+    }
+    printf("%s: %d outstanding: %.0f ns/operation\n",
+	   use_map ? "map" : "table", noutstanding, ns);
+    return 0;
+}
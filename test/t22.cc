@@ -0,0 +1,247 @@
+/* Copyright (c) 2012, Eddie Kohler
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Tamer LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Tamer LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <tamer/tamer.hh>
+#include <tamer/dns.hh>
+
+// DNS replies and the reply cache, offline. Parse crafted packets: a CNAME
+// chain whose records arrive out of order, and negative answers whose TTL
+// comes from the authority SOA. Then check the cache's TTL expiry (moving
+// tamer::now() forward by hand), LRU eviction, and a size bound of 0.
+
+using namespace tamer::dns;
+
+static int nerr;
+
+#define CHECK(x) do {							\
+	if (!(x)) {							\
+	    fprintf(stderr, "%s:%d: FAIL: %s\n", __FILE__, __LINE__, #x); \
+	    ++nerr;							\
+	}								\
+    } while (0)
+
+// A reply packet under construction.
+class wire { public:
+    wire(uint16_t flags, uint16_t qd, uint16_t an, uint16_t ns) {
+	u16(0x1234).u16(flags).u16(qd).u16(an).u16(ns).u16(0);
+    }
+    wire &u8(uint8_t x) {
+	s_.push_back((char) x);
+	return *this;
+    }
+    wire &u16(uint16_t x) {
+	return u8(x >> 8).u8(x);
+    }
+    wire &u32(uint32_t x) {
+	return u16(x >> 16).u16(x);
+    }
+    // "a.b.c" as labels; "@" is a compression pointer to the question name
+    wire &name(const char *n) {
+	if (strcmp(n, "@") == 0)
+	    return u16(0xC00C);
+	while (*n) {
+	    size_t len = strcspn(n, ".");
+	    u8(len);
+	    s_.append(n, len);
+	    n += len + (n[len] == '.');
+	}
+	return u8(0);
+    }
+    wire &question(const char *n, uint16_t type) {
+	return name(n).u16(type).u16(CLASS_INET);
+    }
+    // a record header; the caller appends @a rdlength bytes of data
+    wire &rr(const char *owner, uint16_t type, uint32_t ttl,
+	     uint16_t rdlength) {
+	return name(owner).u16(type).u16(CLASS_INET).u32(ttl).u16(rdlength);
+    }
+    wire &a(const char *owner, uint32_t ttl, uint32_t addr) {
+	return rr(owner, TYPE_A, ttl, 4).u32(addr);
+    }
+    wire &cname(const char *owner, uint32_t ttl, const char *target) {
+	return rr(owner, TYPE_CNAME, ttl, strlen(target) + 2).name(target);
+    }
+    wire &soa(const char *owner, uint32_t ttl, uint32_t minimum) {
+	rr(owner, TYPE_SOA, ttl, 2 * 7 + 5 * 4);
+	return name("ns.zz").name("hm.zz")
+	    .u32(1).u32(7200).u32(3600).u32(86400).u32(minimum);
+    }
+    reply parse() const {
+	return make_reply(make_packet((uint8_t *) s_.data(), s_.size()));
+    }
+  private:
+    std::string s_;
+};
+
+static void check_cname_chain() {
+    // www.example.com -> web.example.com -> host.example.net, listed
+    // backwards, with a stray A record for a name partway along it
+    wire w(0x8180, 1, 5, 0);
+    w.question("www.example.com", TYPE_A)
+	.a("host.example.net", 600, 0x0A000001)
+	.a("web.example.com", 5, 0x0A000063)
+	.cname("web.example.com", 200, "host.example.net")
+	.a("host.example.net", 900, 0x0A000002)
+	.cname("@", 300, "web.example.com");
+    reply r = w.parse();
+    CHECK(r->err == 0 && r->cname == "host.example.net");
+    CHECK(r->addrs.size() == 2 && r->addrs[0] == htonl(0x0A000001)
+	  && r->addrs[1] == htonl(0x0A000002));
+    // the smallest TTL along the chain; the stray record's doesn't count
+    CHECK(r->ttl == 200);
+
+    // no alias: cname stays empty
+    wire w2(0x8180, 1, 1, 0);
+    w2.question("host.example.net", TYPE_A).a("@", 60, 0x0A000001);
+    r = w2.parse();
+    CHECK(r->err == 0 && r->cname.empty() && r->addrs.size() == 1
+	  && r->ttl == 60);
+
+    // a CNAME loop stops after DNS_MAX_CNAME_CHAIN hops with no answer
+    wire w3(0x8180, 1, 2, 0);
+    w3.question("a.zz", TYPE_A).cname("a.zz", 60, "b.zz")
+	.cname("b.zz", 60, "a.zz");
+    r = w3.parse();
+    CHECK(r->err == 0 && r->empty());
+}
+
+static void check_negative() {
+    // NXDOMAIN: the lesser of the SOA's TTL and its MINIMUM
+    wire w(0x8183, 1, 0, 1);
+    w.question("nx.example.com", TYPE_A).soa("example.com", 3600, 60);
+    reply r = w.parse();
+    CHECK(r->err == DNS_ERR_NOTEXIST && r->empty() && r->ttl == 60);
+
+    wire w2(0x8183, 1, 0, 1);
+    w2.question("nx.example.com", TYPE_A).soa("example.com", 45, 600);
+    r = w2.parse();
+    CHECK(r->err == DNS_ERR_NOTEXIST && r->ttl == 45);
+
+    // no data, reached through a CNAME: the chain's TTL bounds it too
+    wire w3(0x8180, 1, 1, 1);
+    w3.question("www.example.com", TYPE_AAAA)
+	.cname("@", 20, "host.example.com").soa("example.com", 3600, 300);
+    r = w3.parse();
+    CHECK(r->err == 0 && r->empty() && r->cname == "host.example.com"
+	  && r->ttl == 20);
+
+    // no SOA: not cacheable
+    wire w4(0x8183, 1, 0, 0);
+    w4.question("nx.example.com", TYPE_A);
+    r = w4.parse();
+    CHECK(r->err == DNS_ERR_NOTEXIST && r->ttl == 0);
+}
+
+static reply make_a(uint32_t ttl, int naddrs) {
+    wire w(0x8180, 1, naddrs, 0);
+    w.question("x.zz", TYPE_A);
+    for (int i = 0; i < naddrs; ++i)
+	w.a("@", ttl, 0x0A000001 + i);
+    reply r = w.parse();
+    CHECK(r->err == 0 && r->ttl == ttl && r->addrs.size() == (size_t) naddrs);
+    return r;
+}
+
+static void check_expiry() {
+    reply_cache c;
+    reply r;
+    c.put("x.zz", TYPE_A, make_a(10, 1));
+    r = c.get("X.ZZ", TYPE_A);
+    CHECK(r && r->ttl == 10 && r->addrs.size() == 1);
+    CHECK(!c.get("x.zz", TYPE_AAAA));
+
+    // a hit reports the TTL that remains
+    tamer::now().tv_sec += 6;
+    r = c.get("x.zz", TYPE_A);
+    CHECK(r && r->ttl == 4);
+    tamer::now().tv_sec += 4;
+    CHECK(!c.get("x.zz", TYPE_A));
+    CHECK(c.stats().hits == 2 && c.stats().misses == 2);
+    CHECK(c.stats().entries == 0 && c.stats().size == 0);
+
+    // negative answers expire the same way
+    wire w(0x8183, 1, 0, 1);
+    w.question("nx.zz", TYPE_A).soa("zz", 3600, 5);
+    c.put("nx.zz", TYPE_A, w.parse());
+    r = c.get("nx.zz", TYPE_A);
+    CHECK(r && r->err == DNS_ERR_NOTEXIST && c.stats().negative_hits == 1);
+    tamer::now().tv_sec += 5;
+    CHECK(!c.get("nx.zz", TYPE_A));
+
+    // TTL 0 is never cached
+    c.put("x.zz", TYPE_A, make_a(0, 1));
+    CHECK(c.stats().entries == 0);
+}
+
+static void check_lru() {
+    reply_cache c;
+    c.put("a.zz", TYPE_A, make_a(60, 1));
+    size_t one = c.stats().size;
+
+    // every address counts toward the size
+    c.put("a.zz", TYPE_A, make_a(60, 4));
+    CHECK(c.stats().entries == 1
+	  && c.stats().size == one + 3 * sizeof(uint32_t));
+    c.put("a.zz", TYPE_A, make_a(60, 1));
+    CHECK(c.stats().size == one);
+
+    // room for two; touching a makes b the least recently used
+    c.set_max_size(2 * one);
+    c.put("b.zz", TYPE_A, make_a(60, 1));
+    CHECK(c.get("a.zz", TYPE_A));
+    c.put("c.zz", TYPE_A, make_a(60, 1));
+    CHECK(c.stats().entries == 2 && c.stats().evictions == 1);
+    CHECK(!c.get("b.zz", TYPE_A));
+    CHECK(c.get("a.zz", TYPE_A) && c.get("c.zz", TYPE_A));
+
+    // shrinking the bound evicts from the old end
+    c.get("a.zz", TYPE_A);
+    c.set_max_size(one);
+    CHECK(c.stats().entries == 1 && c.get("a.zz", TYPE_A)
+	  && !c.get("c.zz", TYPE_A));
+
+    // an entry bigger than the whole bound doesn't stay
+    c.put("d.zz", TYPE_A, make_a(60, 64));
+    CHECK(!c.get("d.zz", TYPE_A) && c.stats().entries == 0);
+}
+
+static void check_size_zero() {
+    reply_cache c(0);
+    c.put("a.zz", TYPE_A, make_a(60, 1));
+    CHECK(!c.get("a.zz", TYPE_A));
+    CHECK(c.stats().entries == 0 && c.stats().size == 0
+	  && c.stats().evictions == 0);
+
+    // a bound of 0 empties a populated cache
+    reply_cache c2;
+    c2.put("a.zz", TYPE_A, make_a(60, 1));
+    c2.put("b.zz", TYPE_A, make_a(60, 1));
+    c2.set_max_size(0);
+    CHECK(c2.stats().entries == 0 && c2.stats().size == 0);
+    CHECK(!c2.get("a.zz", TYPE_A));
+}
+
+int main(int, char **) {
+    tamer::initialize();
+    check_cname_chain();
+    check_negative();
+    check_expiry();
+    check_lru();
+    check_size_zero();
+    tamer::cleanup();
+    printf(nerr ? "FAILED\n" : "ok\n");
+    return nerr ? 1 : 0;
+}